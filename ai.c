@@ -1,177 +1,949 @@
 #include "ai.h"
+#include "tt.h"
+#include "threadpool.h"
+#include "tablebase.h"
+#include "book.h"
+#include "nnue.h"
+#include "mcts.h"
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
 
-static int8_t find_val(const Game* game) {
-    int8_t result = 0;
-    for (int row = 0; row < ROW_SIZE; row++) {
-        for (int col = 0; col < COL_SIZE; col++) {
-            result += game->board[row][col];
+#define CHECK_INTERVAL 1024 // nodes between clock/cancel checks (well under a millisecond)
+
+// move ordering ranks: hash move, then captures (more pieces first), then killers, then history
+#define ORDER_HASH_MOVE   (1 << 30)
+#define ORDER_CAPTURE     (1 << 29)
+#define ORDER_KILLER      (1 << 28)
+#define HISTORY_MAX       (ORDER_KILLER - 1)
+
+#define INFINITE_SCORE (WIN_SCORE + 1)
+#define KNOWN_WIN (WIN_SCORE - MAX_PLY - TB_MAX_DISTANCE) // scores from here up are won games (tablebase win can be found at last ply)
+#define ASPIRATION_WINDOW 50    // half width of first aspiration window (half a man)
+#define ASPIRATION_MIN_DEPTH 4  // shallower iterations are cheap, search them with full window
+#define LMR_MIN_DEPTH 3         // don't reduce close to the leaves
+#define LMR_MIN_MOVE 3          // first moves in the ordering are never reduced
+
+typedef struct SearchContext {
+    SearchOptions options;  // copy taken when search starts
+    TranspositionTable* tt; // NULL if table could not be allocated
+    Tablebase* tb;          // NULL if no tablebase is loaded
+    const Network* nnue;    // NULL: evaluation is find_val
+    uint64_t nodes;
+    uint64_t deadline; // monotonic time in ns, 0 if there is no time limit
+    atomic_bool* ponder; // deadline doesn't apply while this is true
+    atomic_bool* cancel;
+    atomic_bool* abort; // shared by threads searching the same root, any of them can set it to stop the others
+    bool stopped;      // set when search ran out of time or was cancelled, results are not usable
+    BoardMove killers[MAX_PLY][2];  // quiet moves that caused cutoff at ply, most recent first
+    int32_t history[2][SQUARE_COUNT][SQUARE_COUNT]; // [player][from][dest] how often quiet move caused cutoff
+    SearchStats stats;               // counters only, search_iterative adds them up
+    NnueAccumulator accumulators[MAX_PLY + 1]; // [ply] of position being searched at ply (used with nnue)
+    ThreadPool* pool;                // NULL in single-threaded search
+    struct SearchContext* helpers;   // contexts of pool workers, indexed by worker index
+} SearchContext;
+
+// root moves after the first one, searched in parallel (see search_root_parallel)
+typedef struct RootSplit {
+    pthread_mutex_t lock;
+    SearchContext* main;          // context of thread that started search
+    const Board* board;
+    const BoardMoveList* moves;
+    int depth;
+    int alpha;                    // raised as moves finish
+    int beta;
+    int best;
+    int best_index;
+    bool cutoff;                  // some move failed high, the rest of moves are not needed
+    atomic_bool abort;
+} RootSplit;
+
+typedef struct RootTask {
+    RootSplit* split;
+    int index;                    // index of move in split->moves
+} RootTask;
+
+// Lazy SMP helper: searches the same root as the main thread on its own, results reach others through the table
+typedef struct HelperTask {
+    SearchContext* ctx;
+    Board board;                  // copy of root, main thread works on its own board while helpers run
+    int index;                    // 0 .. helper count - 1
+    int max_depth;
+} HelperTask;
+
+// lazy smp helper i skips depth if ((depth + skip_phase[i]) / skip_size[i]) is odd,
+// so at any time helpers are spread over the main thread's depth and the next ones
+static const int skip_size[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const int skip_phase[] = {1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7, 0};
+#define SKIP_PATTERNS (int) (sizeof(skip_size) / sizeof(skip_size[0]))
+
+static TranspositionTable tt;
+static size_t hash_mb = DEFAULT_HASH_MB;
+static SearchOptions options = {true, true, true, false, true, false, true};
+static SearchResult last_result;
+static Tablebase* tablebase = NULL;
+static Book* book = NULL;
+static Network* network = NULL;
+static MctsTree mcts_tree;
+static uint64_t mcts_playouts = DEFAULT_MCTS_PLAYOUTS;
+static FILE* stats_log = NULL;
+
+// pondering: search of computer's reply to expected human move, runs in background while human thinks
+typedef struct Ponder {
+    pthread_t thread;
+    bool running;
+    Board board;              // position after expected human move, search works on it
+    uint64_t key;             // its key (board is changing while search runs)
+    SearchLimits limits;
+    atomic_bool cancel;
+    atomic_bool pondering;    // true until ponder hit, search ignores its time limit meanwhile
+    atomic_bool finished;     // search has returned, result is ready
+    SearchResult result;
+} Ponder;
+
+static Ponder ponder;
+static int thread_count = DEFAULT_THREADS;
+static ThreadPool* pool = NULL;
+
+void ai_set_options(const SearchOptions* new_options) {
+    options = *new_options;
+}
+
+SearchOptions ai_get_options(void) {
+    return options;
+}
+
+// table shared by all searches (it's kept between moves), allocated on first use
+static TranspositionTable* transposition_table(void) {
+    if (tt.buckets == NULL && !tt_init(&tt, hash_mb)) return NULL;
+    return &tt;
+}
+
+// pool of Monte Carlo tree search, allocated on first use
+static MctsTree* monte_carlo_tree(void) {
+    if (mcts_tree.nodes == NULL && !mcts_init(&mcts_tree, hash_mb)) return NULL;
+    return &mcts_tree;
+}
+
+void ai_set_hash_size(size_t megabytes) {
+    hash_mb = megabytes;
+    tt_free(&tt);
+    mcts_free(&mcts_tree);
+}
+
+void ai_set_mcts_playouts(uint64_t playouts) {
+    mcts_playouts = (playouts == 0) ? DEFAULT_MCTS_PLAYOUTS : playouts;
+}
+
+void ai_set_threads(int threads) {
+    thread_count = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+    threadpool_destroy(pool);
+    pool = NULL;
+}
+
+bool ai_load_tablebase(const char* path) {
+    Tablebase* tb = tb_open(path);
+    if (tb == NULL) return false;
+    tb_close(tablebase);
+    tablebase = tb;
+    return true;
+}
+
+bool ai_load_book(const char* path) {
+    Book* opened = book_open(path);
+    if (opened == NULL) return false;
+    book_close(book);
+    book = opened;
+    return true;
+}
+
+bool ai_load_nnue(const char* path) {
+    Network* loaded = nnue_load(path);
+    if (loaded == NULL) return false;
+    nnue_free(network);
+    network = loaded;
+    return true;
+}
+
+int ai_get_threads(void) {
+    return thread_count;
+}
+
+// thread that starts search takes part in it, so pool has one thread less than search uses
+static ThreadPool* search_pool(void) {
+    if (pool == NULL && thread_count > 1) pool = threadpool_create(thread_count - 1);
+    return pool;
+}
+
+// win/loss scores are stored relative to the position (plies from it), not to the root
+static int score_to_tt(int score, int ply) {
+    if (score >= KNOWN_WIN) return score + ply;
+    if (score <= -KNOWN_WIN) return score - ply;
+    return score;
+}
+
+static int score_from_tt(int score, int ply) {
+    if (score >= KNOWN_WIN) return score - ply;
+    if (score <= -KNOWN_WIN) return score + ply;
+    return score;
+}
+
+bool ai_is_known_result(int score) {
+    return score >= KNOWN_WIN || score <= -KNOWN_WIN;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static bool is_pondering(const SearchContext* ctx) {
+    return ctx->ponder != NULL && atomic_load_explicit(ctx->ponder, memory_order_relaxed);
+}
+
+static bool should_stop(SearchContext* ctx) {
+    if (ctx->stopped) return true;
+    if (ctx->nodes % CHECK_INTERVAL != 0) return false;
+    if (ctx->abort != NULL && atomic_load_explicit(ctx->abort, memory_order_relaxed)) {
+        ctx->stopped = true;
+    } else if ((ctx->cancel != NULL && atomic_load_explicit(ctx->cancel, memory_order_relaxed))
+               || (ctx->deadline != 0 && !is_pondering(ctx) && now_ns() >= ctx->deadline)) {
+        ctx->stopped = true;
+        if (ctx->abort != NULL) atomic_store(ctx->abort, true);
+    }
+    return ctx->stopped;
+}
+
+int find_val(const Board* board) {
+    return board->value;
+}
+
+// static evaluation from the point of view of player to move
+static int evaluate(const SearchContext* ctx, const Board* board, int ply) {
+    if (ctx->nnue != NULL) return nnue_evaluate(ctx->nnue, &ctx->accumulators[ply], board->current_player);
+    int value = find_val(board);
+    return (board->current_player == human) ? value : -value;
+}
+
+// make_move that also brings network's accumulator of the next ply up to date
+static void make_search_move(SearchContext* ctx, Board* board, const BoardMove* move, int ply, Undo* undo) {
+    if (ctx->nnue != NULL) nnue_update(ctx->nnue, &ctx->accumulators[ply], &ctx->accumulators[ply + 1], board, move);
+    make_move(board, move, undo);
+}
+
+// accumulator of root position, the rest of them follow from it
+static void start_accumulators(SearchContext* ctx, const Board* board) {
+    if (ctx->nnue != NULL) nnue_refresh(ctx->nnue, board, &ctx->accumulators[0]);
+}
+
+static bool same_move(const BoardMove* lhs, const BoardMove* rhs) {
+    return lhs->from == rhs->from && lhs->dest == rhs->dest && lhs->captured == rhs->captured;
+}
+
+// gives every move its rank, see ORDER_* (higher is searched earlier)
+static void rank_moves(const SearchContext* ctx, const Board* board, const BoardMoveList* moves,
+                       const TTData* entry, int ply, int32_t* ranks) {
+    const int32_t (*history)[SQUARE_COUNT] = ctx->history[board->current_player];
+    for (int i = 0; i < moves->count; i++) {
+        const BoardMove* move = &moves->moves[i];
+        if (entry != NULL && entry->move_from == move->from && entry->move_dest == move->dest) {
+            ranks[i] = ORDER_HASH_MOVE;
+        } else if (move->captured != 0) {
+            ranks[i] = ORDER_CAPTURE + __builtin_popcount(move->captured) * 2
+                       + __builtin_popcount(move->captured & board->kings);
+        } else if (same_move(move, &ctx->killers[ply][0])) {
+            ranks[i] = ORDER_KILLER + 1;
+        } else if (same_move(move, &ctx->killers[ply][1])) {
+            ranks[i] = ORDER_KILLER;
+        } else {
+            ranks[i] = history[move->from][move->dest];
         }
     }
-    return result;
 }
 
-// takes jump move as parameter. (assume move is valid) returns true if there is multi-jump
-static bool multi_jump_required(const Game* game, const Move* move) {
-    Game game_copy = *game;
-    move_piece(&game_copy, move);
-    vector* moves = all_moves_for_piece(&game_copy, &move->dest);
-    if (has_jump_move(moves)) {
-        VectorDispose(moves);
-        return true;
+// moves best ranked of the remaining moves (index >= i) to index i
+static void pick_move(BoardMoveList* moves, int32_t* ranks, int i) {
+    int best = i;
+    for (int j = i + 1; j < moves->count; j++) {
+        if (ranks[j] > ranks[best]) best = j;
+    }
+    if (best == i) return;
+    BoardMove move = moves->moves[i];
+    moves->moves[i] = moves->moves[best];
+    moves->moves[best] = move;
+    int32_t rank = ranks[i];
+    ranks[i] = ranks[best];
+    ranks[best] = rank;
+}
+
+// quiet move refuted opponent's move, try it early in sibling positions and wherever it is legal
+static void update_quiet_stats(SearchContext* ctx, const Board* board, const BoardMove* move, int depth, int ply) {
+    if (!same_move(move, &ctx->killers[ply][0])) {
+        ctx->killers[ply][1] = ctx->killers[ply][0];
+        ctx->killers[ply][0] = *move;
+    }
+    int32_t (*history)[SQUARE_COUNT] = ctx->history[board->current_player];
+    history[move->from][move->dest] += depth * depth;
+    if (history[move->from][move->dest] > HISTORY_MAX) {
+        // keep relative order, but make room
+        for (int from = 0; from < SQUARE_COUNT; from++) {
+            for (int dest = 0; dest < SQUARE_COUNT; dest++) history[from][dest] /= 2;
+        }
     }
-    VectorDispose(moves);
-    return false;
 }
 
 /*
- * Fills states vector with all possible game states that can be formed from this move
- * ---------------------------------------------------------
- * if move is regular move, there will be only one game state
- * if move is jump move, maybe player has more moves (multi-jumps) to make
- * so there will be different game states for all paths player can take for multi-jump
- * if player does not have multi-jump after jump move, there will be only one game state
- * (assuming move is valid, so no check for validity)
- * @param game game state
- * @param move move to make
- * @param game_states vector of Game structs
+ * Quiescence search: position is not scored while player to move has a (forced) jump,
+ * only jump moves (with their multi-jump paths) are followed until position is quiet.
+ * there is no "stand pat", jumps in checkers are not optional
  */
-static void move_game_states(const Game* game, const Move* move, vector* game_states) {
-    Game new_game_state = *game;
-    move_piece(&new_game_state, move); // make move
-    VectorAppend(game_states, &new_game_state); // add this new game state to vector
-    // if move is regular move there is no more moves
-    if (!move_is_jump(move)) return;
-    // if move is jump but there is no more moves return
-    if (!multi_jump_required(game, move)) return;
-	VectorDelete(game_states, VectorLength(game_states)-1);
-    vector* moves = all_moves_for_piece(&new_game_state, &move->dest);
-    for (int i = 0; i < VectorLength(moves); i++) {
-        const Move* mv = VectorNth(moves, i);
-        move_game_states(&new_game_state, mv, game_states);
-    }
-    VectorDispose(moves);
-}
-
-// gives node ownership to caller
-void create_tree(Node* root, int depth) {
-    // copy initial game state to root
-    root->value = find_val(&root->game);
-    VectorNew(&root->children, sizeof(Node), NULL, 1); // initialize children vector;
-    if (depth == 0) {
-        return;
-    }
-    // find all possible moves from this game state
-    vector moves;
-    VectorNew(&moves, sizeof(Move), NULL, 6);
-    all_moves(&root->game, root->game.current_player, &moves);
-    bool jump = has_jump_move(&moves); // if ai has jump moves it should jump
-    // make this moves and create corresponding nodes. append to children
-    for (int i = 0; i < VectorLength(&moves); i++) {
-        Move* move = VectorNth(&moves, i); // get move from possible moves
-        if (jump && !move_is_jump(move)) continue; // if ai has to jump but this move is not jump, skip
-        // create vector to store all game states that can be formed from this move
-        vector states;
-        VectorNew(&states, sizeof(Game), NULL, 4);
-        move_game_states(&root->game, move, &states);
-        // create child node(s) and add to children vector of root
-        for (int j = 0; j < VectorLength(&states); j++) {
-            Game* state = VectorNth(&states, j);
-            switch_player(state); // don't forget to switch player manually after move is done
-            Node child;
-            child.game = *state;
-            //child.value = find_val(&child.game);
-            VectorAppend(&root->children, &child);
+static int quiesce(SearchContext* ctx, Board* board, int ply, int alpha, int beta) {
+    ctx->nodes++;
+    ctx->stats.qnodes++;
+    if (should_stop(ctx)) return 0;
+    if (board_pieces_count(board, board->current_player) == 0) return -WIN_SCORE + ply;
+    if (ply >= MAX_PLY || !board_has_captures(board)) return evaluate(ctx, board, ply);
+
+    BoardMoveList moves;
+    board_moves(board, &moves); // only jumps, they are forced
+    int32_t ranks[MAX_BOARD_MOVES];
+    rank_moves(ctx, board, &moves, NULL, ply, ranks);
+
+    int best = -INFINITE_SCORE;
+    for (int i = 0; i < moves.count; i++) {
+        pick_move(&moves, ranks, i);
+        Undo undo;
+        make_search_move(ctx, board, &moves.moves[i], ply, &undo);
+        int score = -quiesce(ctx, board, ply + 1, -beta, -alpha);
+        unmake_move(board, &moves.moves[i], &undo);
+        if (ctx->stopped) return 0;
+        if (score > best) {
+            best = score;
+            if (score > alpha) alpha = score;
+            if (alpha >= beta) break;
         }
-        VectorDispose(&states);
-    }
-    VectorDispose(&moves); // don't need anymore
-    // now we have root node with current game state, having its children game states
-    // call recursively
-    for (int i = 0; i < VectorLength(&root->children); i++) {
-        Node* child = VectorNth(&root->children, i);
-        create_tree(child, depth-1);
     }
+    return best;
 }
 
-static void free_tree(Node* root) {
-    if (root == NULL) return;
-    for (int i = 0; i < VectorLength(&root->children); i++) {
-        Node* child = VectorNth(&root->children, i);
-        free_tree(child);
+/*
+ * Fail-soft negamax with alpha-beta pruning
+ * returns score of position from the point of view of player to move.
+ * player without pieces has lost, player who has pieces but can't move gets a draw (same as game_loop)
+ */
+static int negamax(SearchContext* ctx, Board* board, int depth, int ply, int alpha, int beta) {
+    if (depth <= 0 || ply >= MAX_PLY) return quiesce(ctx, board, ply, alpha, beta);
+    ctx->nodes++;
+    if (should_stop(ctx)) return 0;
+    if (board_pieces_count(board, board->current_player) == 0) return -WIN_SCORE + ply;
+
+    // with few pieces left the result is known exactly, win sooner / lose later is better
+    TBValue tb_value;
+    if (ctx->tb != NULL && tb_probe(ctx->tb, board, &tb_value)) {
+        ctx->stats.tb_hits++;
+        if (tb_value.outcome == TB_RESULT_WIN) return WIN_SCORE - ply - tb_value.distance;
+        if (tb_value.outcome == TB_RESULT_LOSS) return -WIN_SCORE + ply + tb_value.distance;
+        return 0;
     }
-    VectorDispose(&root->children);
-}
 
-// dumb test
-void ai_move_dumb(Game* game) {
-    Node root;
-    root.game = *game;
-    create_tree(&root, 3);
-
-    int8_t res = 100;
-    Game min_state;
-    for (int i = 0; i < VectorLength(&root.children); i++) {
-        Node* node = VectorNth(&root.children, i);
-        int8_t tmp = find_val(&node->game);
-        if (tmp < res) {
-            res = tmp;
-            min_state = node->game;
+    // position may have been searched already (through another move order or in earlier iteration)
+    TTData entry;
+    bool tt_hit = false;
+    if (ctx->tt != NULL) {
+        tt_hit = tt_probe(ctx->tt, board->key, &entry);
+        ctx->stats.tt_probes++;
+        ctx->stats.tt_hits += tt_hit;
+    }
+    if (tt_hit && entry.depth >= depth) {
+        int score = score_from_tt(entry.score, ply);
+        if (entry.bound == BOUND_EXACT
+            || (entry.bound == BOUND_LOWER && score >= beta)
+            || (entry.bound == BOUND_UPPER && score <= alpha)) {
+            return score;
+        }
+    }
+
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    if (moves.count == 0) return 0;
+    int32_t ranks[MAX_BOARD_MOVES];
+    rank_moves(ctx, board, &moves, tt_hit ? &entry : NULL, ply, ranks);
+
+    int alpha_orig = alpha;
+    int best = -WIN_SCORE - 1;
+    const BoardMove* best_move = NULL;
+    for (int i = 0; i < moves.count; i++) {
+        pick_move(&moves, ranks, i);
+        const BoardMove* move = &moves.moves[i];
+        Undo undo;
+        make_search_move(ctx, board, move, ply, &undo);
+        int score;
+        if (i == 0) {
+            score = -negamax(ctx, board, depth - 1, ply + 1, -beta, -alpha);
+        } else {
+            // late quiet moves are rarely best, look at them with reduced depth first
+            int reduction = 0;
+            if (ctx->options.lmr && depth >= LMR_MIN_DEPTH && i >= LMR_MIN_MOVE
+                && move->captured == 0 && ranks[i] < ORDER_KILLER) {
+                reduction = (depth >= 6 && i >= 2 * LMR_MIN_MOVE) ? 2 : 1;
+            }
+            // with pvs, later moves only have to prove they are not better than alpha (null window)
+            int window_beta = ctx->options.pvs ? alpha + 1 : beta;
+            score = -negamax(ctx, board, depth - 1 - reduction, ply + 1, -window_beta, -alpha);
+            if (score > alpha && reduction > 0) {
+                score = -negamax(ctx, board, depth - 1, ply + 1, -window_beta, -alpha);
+            }
+            if (score > alpha && score < beta && window_beta != beta) {
+                score = -negamax(ctx, board, depth - 1, ply + 1, -beta, -alpha);
+            }
+        }
+        unmake_move(board, move, &undo);
+        if (ctx->stopped) return 0;
+        if (score > best) {
+            best = score;
+            best_move = move;
+            if (score > alpha) alpha = score;
+            if (alpha >= beta) { // opponent won't allow this line
+                ctx->stats.cutoffs++;
+                if (i == 0) ctx->stats.first_move_cutoffs++;
+                if (best_move->captured == 0) update_quiet_stats(ctx, board, best_move, depth, ply);
+                break;
+            }
         }
     }
-    *game = min_state;
-    free_tree(&root);
+
+    if (ctx->tt != NULL) {
+        // when no move raised alpha, best move is not known (all we know is that none is good enough)
+        Bound bound = (best <= alpha_orig) ? BOUND_UPPER : (best >= beta) ? BOUND_LOWER : BOUND_EXACT;
+        tt_store(ctx->tt, board->key, score_to_tt(best, ply), depth, bound, (bound == BOUND_UPPER) ? NULL : best_move);
+    }
+    return best;
 }
-static void min(Node* root) {
-    if (VectorLength(&root->children) == 0) return;
-    int8_t min_val = 127;
-    for (int i = 0; i < VectorLength(&root->children); i++) {
-        Node* child = VectorNth(&root->children, i);
-        if (child->value < min_val) {
-            min_val = child->value;
+
+/*
+ * Searches root moves to given depth with window (alpha, beta), returns score (fail-soft)
+ * and sets best_index to index of best move. result is not usable if search was stopped
+ */
+static int search_root(SearchContext* ctx, Board* board, const BoardMoveList* moves, int depth,
+                       int alpha, int beta, int* best_index) {
+    int best = -INFINITE_SCORE;
+    for (int i = 0; i < moves->count; i++) {
+        Undo undo;
+        make_search_move(ctx, board, &moves->moves[i], 0, &undo);
+        int score;
+        if (i == 0 || !ctx->options.pvs) {
+            score = -negamax(ctx, board, depth - 1, 1, -beta, -alpha);
+        } else {
+            score = -negamax(ctx, board, depth - 1, 1, -alpha - 1, -alpha);
+            if (score > alpha && score < beta) score = -negamax(ctx, board, depth - 1, 1, -beta, -alpha);
+        }
+        unmake_move(board, &moves->moves[i], &undo);
+        if (ctx->stopped) return best;
+        if (score > best) {
+            best = score;
+            *best_index = i;
+            if (score > alpha) alpha = score;
+            if (alpha >= beta) break;
         }
     }
-    root->value = min_val;
+    return best;
 }
 
-static void max(Node* root) {
-    if (VectorLength(&root->children) == 0) return;
-    int8_t max_val = -128;
-    for (int i = 0; i < VectorLength(&root->children); i++) {
-        Node* child = VectorNth(&root->children, i);
-        if (child->value > max_val) {
-            max_val = child->value;
+// searches one root move of split in whatever thread picked the task
+static void search_root_move(void* arg) {
+    const RootTask* task = arg;
+    RootSplit* split = task->split;
+    int worker = threadpool_worker_index(split->main->pool);
+    SearchContext* ctx = (worker >= 0) ? &split->main->helpers[worker] : split->main;
+    if (atomic_load(&split->abort)) return;
+
+    pthread_mutex_lock(&split->lock);
+    int alpha = split->alpha;
+    int beta = split->beta;
+    // serial search keeps the first of equally good moves, so move before current best has to be searched
+    // with alpha one lower to tell whether it only ties
+    if (task->index < split->best_index) alpha--;
+    pthread_mutex_unlock(&split->lock);
+
+    Board board = *split->board;
+    const BoardMove* move = &split->moves->moves[task->index];
+    start_accumulators(ctx, &board);
+    Undo undo;
+    make_search_move(ctx, &board, move, 0, &undo);
+    int score;
+    if (ctx->options.pvs) {
+        score = -negamax(ctx, &board, split->depth - 1, 1, -alpha - 1, -alpha);
+        if (score > alpha && score < beta && !ctx->stopped) score = -negamax(ctx, &board, split->depth - 1, 1, -beta, -alpha);
+    } else {
+        score = -negamax(ctx, &board, split->depth - 1, 1, -beta, -alpha);
+    }
+    if (ctx->stopped) return;
+
+    pthread_mutex_lock(&split->lock);
+    if (score > split->best || (score == split->best && task->index < split->best_index)) {
+        split->best = score;
+        split->best_index = task->index;
+        if (score > split->alpha) split->alpha = score;
+        if (split->alpha >= split->beta) {
+            split->cutoff = true;
+            atomic_store(&split->abort, true);
         }
     }
-    root->value = max_val;
+    pthread_mutex_unlock(&split->lock);
 }
 
-void ai_move(Game* game, int depth) {
-    Node root;
-    root.game = *game;
-    create_tree(&root, depth);
-    set_child_values(&root, depth, MIN);
-    // travers root's children and pick minimum
-    for (int i = 0; i < VectorLength(&root.children); i++) {
-        Node* child = VectorNth(&root.children, i);
-        if (child->value == root.value) {
-            *game = child->game;
+/*
+ * Same as search_root, but moves after the first one are searched in parallel by threads of pool.
+ * first move is searched alone, it's most likely the best one and its score gives the other moves
+ * a window to search with. bounds are shared, every finished move raises alpha for moves that start later
+ */
+static int search_root_parallel(SearchContext* ctx, Board* board, const BoardMoveList* moves, int depth,
+                                int alpha, int beta, int* best_index) {
+    Undo undo;
+    make_search_move(ctx, board, &moves->moves[0], 0, &undo);
+    int best = -negamax(ctx, board, depth - 1, 1, -beta, -alpha);
+    unmake_move(board, &moves->moves[0], &undo);
+    *best_index = 0;
+    if (ctx->stopped || best >= beta || moves->count == 1) return best;
+
+    RootSplit split = {.main = ctx, .board = board, .moves = moves, .depth = depth,
+                       .alpha = (best > alpha) ? best : alpha, .beta = beta, .best = best, .best_index = 0};
+    pthread_mutex_init(&split.lock, NULL);
+    atomic_init(&split.abort, false);
+    RootTask tasks[MAX_BOARD_MOVES];
+    TaskGroup group;
+    task_group_init(&group);
+    for (int i = 0; i < ctx->pool->size; i++) {
+        SearchContext* helper = &ctx->helpers[i];
+        helper->stopped = false;
+        helper->abort = &split.abort;
+    }
+    ctx->abort = &split.abort;
+    for (int i = 1; i < moves->count; i++) {
+        tasks[i] = (RootTask) {&split, i};
+        threadpool_submit(ctx->pool, &group, search_root_move, &tasks[i]);
+    }
+    threadpool_wait(ctx->pool, &group);
+    ctx->abort = NULL;
+    pthread_mutex_destroy(&split.lock);
+
+    // abort without cutoff means that time ran out or search was cancelled
+    ctx->stopped = !split.cutoff && atomic_load(&split.abort);
+    *best_index = split.best_index;
+    return split.best;
+}
+
+/*
+ * Completes one iteration, false if search was stopped before it finished
+ * with aspiration windows the root is searched with narrow window around previous score,
+ * window is widened when true score turns out to be outside of it
+ * best move is moved to the front of the list, so next iteration starts with it
+ */
+static bool search_iteration(SearchContext* ctx, Board* board, BoardMoveList* moves, int depth, SearchResult* result) {
+    int alpha = -INFINITE_SCORE;
+    int beta = INFINITE_SCORE;
+    int delta = ASPIRATION_WINDOW;
+    bool known_result = ai_is_known_result(result->score);
+    if (ctx->options.aspiration && depth >= ASPIRATION_MIN_DEPTH && !known_result) {
+        alpha = result->score - delta;
+        beta = result->score + delta;
+    }
+
+    int best_index = 0;
+    int score;
+    while (true) {
+        score = (ctx->pool != NULL)
+                ? search_root_parallel(ctx, board, moves, depth, alpha, beta, &best_index)
+                : search_root(ctx, board, moves, depth, alpha, beta, &best_index);
+        if (ctx->stopped) return false;
+        if (score <= alpha && alpha > -INFINITE_SCORE) {
+            alpha = (alpha - delta > -INFINITE_SCORE) ? alpha - delta : -INFINITE_SCORE;
+        } else if (score >= beta && beta < INFINITE_SCORE) {
+            beta = (beta + delta < INFINITE_SCORE) ? beta + delta : INFINITE_SCORE;
+        } else {
             break;
         }
+        delta *= 2;
+    }
+
+    BoardMove best_move = moves->moves[best_index];
+    memmove(&moves->moves[1], &moves->moves[0], best_index * sizeof(BoardMove));
+    moves->moves[0] = best_move;
+
+    result->score = score;
+    result->move = best_move;
+    result->depth = depth;
+    if (ctx->tt != NULL) tt_store(ctx->tt, board->key, score_to_tt(score, 0), depth, BOUND_EXACT, &best_move);
+    return true;
+}
+
+static void lazy_helper(void* arg) {
+    const HelperTask* task = arg;
+    SearchContext* ctx = task->ctx;
+    Board board = task->board;
+    start_accumulators(ctx, &board);
+    BoardMoveList moves;
+    board_moves(&board, &moves);
+    SearchResult result = {0};
+    int pattern = task->index % SKIP_PATTERNS;
+    for (int depth = 1; depth <= task->max_depth; depth++) {
+        if (((depth + skip_phase[pattern]) / skip_size[pattern]) % 2 != 0) continue;
+        if (!search_iteration(ctx, &board, &moves, depth, &result)) break;
+        if (ai_is_known_result(result.score)) break;
     }
-    free_tree(&root);
 }
 
-void set_child_values(Node* root, int depth, MinMax minmax) {
-    if (VectorLength(&root->children) == 0 || depth == 0) return;
-    for (int i = 0; i < VectorLength(&root->children); i++) {
-        Node* child = VectorNth(&root->children, i);
-        set_child_values(child, depth-1, (minmax == MAX) ? MIN : MAX);
-        if (minmax == MAX) {
-            max(root);
-        } else {
-            min(root);
+static long peak_memory_kb(void) {
+    struct rusage usage;
+    return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+// nodes searched so far by threads whose counters can be read now (root split helpers are idle between iterations)
+static uint64_t searched_nodes(const SearchContext* ctx, int helper_count) {
+    uint64_t nodes = ctx->nodes;
+    for (int i = 0; ctx->helpers != NULL && i < helper_count; i++) nodes += ctx->helpers[i].nodes;
+    return nodes;
+}
+
+static void add_stats(SearchStats* total, const SearchStats* part) {
+    total->cutoffs += part->cutoffs;
+    total->first_move_cutoffs += part->first_move_cutoffs;
+    total->tt_probes += part->tt_probes;
+    total->tt_hits += part->tt_hits;
+    total->tb_hits += part->tb_hits;
+    total->qnodes += part->qnodes;
+}
+
+static void finish_stats(SearchStats* stats, int depth, uint64_t start) {
+    if (depth >= 2 && stats->depth_nodes[depth - 1] > 0) {
+        stats->branching_factor = (double) stats->depth_nodes[depth] / (double) stats->depth_nodes[depth - 1];
+    }
+    stats->elapsed_us = (now_ns() - start) / 1000;
+    stats->peak_memory_kb = peak_memory_kb();
+}
+
+SearchResult search_iterative(Board* board, const SearchLimits* limits) {
+    uint64_t start = now_ns();
+    SearchContext ctx = {0};
+    ctx.options = options;
+    ctx.deadline = (limits->time_ms != 0) ? start + (uint64_t) limits->time_ms * 1000000u : 0;
+    ctx.cancel = limits->cancel;
+    ctx.ponder = limits->ponder;
+    ctx.tt = transposition_table();
+    if (ctx.tt != NULL) tt_new_search(ctx.tt);
+    ctx.tb = tablebase;
+    ctx.nnue = options.nnue ? network : NULL;
+    start_accumulators(&ctx, board);
+    SearchResult result = {0};
+    result.threads = 1;
+
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    if (moves.count == 0) {
+        result.score = (board_pieces_count(board, board->current_player) == 0) ? -WIN_SCORE : 0;
+        finish_stats(&result.stats, 0, start);
+        return result;
+    }
+    // until some iteration is completed, any legal move will do
+    result.has_move = true;
+    result.move = moves.moves[0];
+    if (moves.count == 1 && limits->time_ms != 0) { // forced move, nothing to think about
+        finish_stats(&result.stats, 0, start);
+        return result;
+    }
+
+    int max_depth = (limits->max_depth > 0 && limits->max_depth < MAX_PLY) ? limits->max_depth : MAX_PLY;
+
+    // every thread has its own killers and history, table is shared
+    ThreadPool* threads = (moves.count > 1) ? search_pool() : NULL;
+    SearchContext* helpers = NULL;
+    HelperTask* helper_tasks = NULL;
+    TaskGroup helper_group;
+    atomic_bool helpers_abort;
+    if (threads != NULL) {
+        // aligned for the accumulators (size of struct is a multiple of its alignment)
+        helpers = aligned_alloc(_Alignof(SearchContext), threads->size * sizeof(SearchContext));
+        if (helpers != NULL) memset(helpers, 0, threads->size * sizeof(SearchContext));
+        helper_tasks = calloc(threads->size, sizeof(HelperTask));
+        if (helpers == NULL || helper_tasks == NULL) threads = NULL;
+    }
+    for (int i = 0; threads != NULL && i < threads->size; i++) {
+        helpers[i].options = ctx.options;
+        helpers[i].tt = ctx.tt;
+        helpers[i].tb = ctx.tb;
+        helpers[i].nnue = ctx.nnue;
+        helpers[i].deadline = ctx.deadline;
+        helpers[i].ponder = ctx.ponder;
+        helpers[i].cancel = ctx.cancel;
+    }
+    if (threads != NULL && ctx.options.lazy_smp) {
+        // helpers run until main thread is done, main thread's iterations give the result
+        atomic_init(&helpers_abort, false);
+        task_group_init(&helper_group);
+        ctx.abort = &helpers_abort;
+        for (int i = 0; i < threads->size; i++) {
+            helpers[i].abort = &helpers_abort;
+            helper_tasks[i] = (HelperTask) {&helpers[i], *board, i, max_depth};
+            threadpool_submit(threads, &helper_group, lazy_helper, &helper_tasks[i]);
         }
+    } else if (threads != NULL) {
+        ctx.pool = threads;
+        ctx.helpers = helpers;
+    }
+
+    uint64_t counted_nodes = 0;
+    for (int depth = 1; depth <= max_depth; depth++) {
+        if (!search_iteration(&ctx, board, &moves, depth, &result)) break;
+        uint64_t nodes = searched_nodes(&ctx, (threads != NULL) ? threads->size : 0);
+        ctx.stats.depth_nodes[depth] = nodes - counted_nodes;
+        counted_nodes = nodes;
+        if (ai_is_known_result(result.score)) break; // game result is known
+        // next iteration takes several times longer than this one, don't start it if it can't finish
+        if (ctx.deadline != 0 && !is_pondering(&ctx) && now_ns() - start > (ctx.deadline - start) / 2) break;
+    }
+    if (threads != NULL && ctx.options.lazy_smp) {
+        atomic_store(&helpers_abort, true);
+        threadpool_wait(threads, &helper_group);
+    }
+
+    result.threads = 1;
+    result.nodes = result.thread_nodes[0] = ctx.nodes;
+    for (int i = 0; threads != NULL && i < threads->size; i++) {
+        result.thread_nodes[result.threads++] = helpers[i].nodes;
+        result.nodes += helpers[i].nodes;
+        add_stats(&ctx.stats, &helpers[i].stats);
     }
+    result.stats = ctx.stats;
+    finish_stats(&result.stats, result.depth, start);
+    free(helpers);
+    free(helper_tasks);
+    return result;
+}
+
+SearchResult search(Board* board, int depth) {
+    SearchLimits limits = {depth, 0, NULL, NULL};
+    return search_iterative(board, &limits);
+}
+
+// dumb test: greedy, takes move that wins the most material right away
+void ai_move_dumb(Game* game) {
+    ai_move(game, 1);
+}
+
+static void* ponder_main(void* arg) {
+    (void) arg;
+    ponder.result = search_iterative(&ponder.board, &ponder.limits);
+    atomic_store(&ponder.finished, true);
+    return NULL;
 }
 
+void ai_ponder_start(const Game* game, uint32_t time_ms) {
+    ai_ponder_stop();
+    if (options.mcts) return; // expected human move comes from transposition table, MCTS doesn't fill it
+    Board board;
+    board_from_game(&board, game);
+    // expected human move is the one computer's last search found best for human
+    TranspositionTable* table = transposition_table();
+    TTData entry;
+    if (table == NULL || !tt_probe(table, board.key, &entry) || entry.move_from == TT_NO_MOVE) return;
+    BoardMoveList moves;
+    board_moves(&board, &moves);
+    const BoardMove* expected = NULL;
+    for (int i = 0; i < moves.count && expected == NULL; i++) {
+        if (moves.moves[i].from == entry.move_from && moves.moves[i].dest == entry.move_dest) expected = &moves.moves[i];
+    }
+    if (expected == NULL) return;
+
+    apply_move(&board, expected);
+    if (book != NULL && book_find(book, board.key) != NULL) return; // reply is in book, nothing to think about
+    ponder.board = board;
+    ponder.key = board.key;
+    ponder.limits = (SearchLimits) {0, time_ms, &ponder.cancel, &ponder.pondering};
+    atomic_store(&ponder.cancel, false);
+    atomic_store(&ponder.pondering, true);
+    atomic_store(&ponder.finished, false);
+    ponder.running = pthread_create(&ponder.thread, NULL, ponder_main, NULL) == 0;
+}
+
+void ai_ponder_stop(void) {
+    if (!ponder.running) return;
+    atomic_store(&ponder.cancel, true);
+    pthread_join(ponder.thread, NULL);
+    ponder.running = false;
+}
+
+bool ai_is_pondering(void) {
+    return ponder.running;
+}
+
+/*
+ * Ends pondering before computer's move, returns true and fills result on ponder hit:
+ * human played expected move, search goes on with time limit now (counted from when pondering started)
+ * and its result is used. on miss pondering is cancelled, what it stored in transposition table stays there
+ */
+static bool ponder_finish(const Board* board, const SearchLimits* limits, SearchResult* result) {
+    if (!ponder.running) return false;
+    bool hit = board->key == ponder.key && limits->max_depth == 0 && limits->time_ms == ponder.limits.time_ms;
+    if (!hit) {
+        ai_ponder_stop();
+        return false;
+    }
+    atomic_store(&ponder.pondering, false);
+    // caller's cancel flag has to reach the pondering search, which has its own
+    struct timespec pause = {0, 1000000};
+    while (!atomic_load(&ponder.finished)) {
+        if (limits->cancel != NULL && atomic_load(limits->cancel)) atomic_store(&ponder.cancel, true);
+        nanosleep(&pause, NULL);
+    }
+    pthread_join(ponder.thread, NULL);
+    ponder.running = false;
+    *result = ponder.result;
+    return true;
+}
+
+// move of opening book, false if position isn't in it
+static bool book_result(const Board* board, SearchResult* result) {
+    if (book == NULL) return false;
+    SearchResult found = {0};
+    if (!book_probe(book, board, &found.move, &found.score)) return false;
+    found.depth = (int) book->header->depth;
+    found.has_move = true;
+    found.from_book = true;
+    found.threads = 1;
+    *result = found;
+    return true;
+}
+
+// Monte Carlo tree search on all search threads, falls back to alpha-beta if its pool can't be allocated
+static SearchResult search_monte_carlo(Board* board, const SearchLimits* limits) {
+    MctsTree* tree = monte_carlo_tree();
+    if (tree == NULL) return search_iterative(board, limits);
+    MctsLimits mcts_limits = {(limits->time_ms != 0) ? 0 : mcts_playouts, limits->time_ms, limits->cancel, options.mcts_prior};
+    return mcts_search(tree, board, &mcts_limits, search_pool());
+}
+
+// computer's move in board, from book or from pondering search if it was a hit
+static SearchResult think(Board* board, const SearchLimits* limits) {
+    uint64_t start = now_ns();
+    SearchResult result;
+    if (book_result(board, &result)) {
+        ai_ponder_stop();
+    } else if (options.mcts) {
+        ai_ponder_stop();
+        result = search_monte_carlo(board, limits);
+    } else if (!ponder_finish(board, limits, &result)) {
+        result = search_iterative(board, limits);
+    }
+    // caller waited this long (pondering search started earlier)
+    result.stats.elapsed_us = (now_ns() - start) / 1000;
+    result.stats.peak_memory_kb = peak_memory_kb();
+    if (stats_log != NULL) ai_write_stats_json(stats_log, &result);
+    return result;
+}
+
+static void play_result(Game* game, const SearchResult* result) {
+    last_result = *result;
+    if (!result->has_move) return;
+    Board board;
+    board_from_game(&board, game);
+    apply_move(&board, &result->move);
+    board_to_game(&board, game);
+}
+
+static void make_ai_move(Game* game, const SearchLimits* limits) {
+    Board board;
+    board_from_game(&board, game);
+    SearchResult result = think(&board, limits);
+    play_result(game, &result);
+}
+
+void ai_write_stats_json(FILE* file, const SearchResult* result) {
+    const SearchStats* stats = &result->stats;
+    char move[BOARD_MOVE_STRING_SIZE] = "";
+    if (result->has_move) board_move_to_string(&result->move, move);
+    double seconds = (double) stats->elapsed_us / 1e6;
+    fprintf(file, "{\"move\": \"%s\", \"score\": %d, \"depth\": %d, \"book\": %s, \"threads\": %d, "
+                  "\"nodes\": %llu, \"elapsed_us\": %llu, \"nps\": %.0f, \"depth_nodes\": [",
+            move, result->score, result->depth, result->from_book ? "true" : "false", result->threads,
+            (unsigned long long) result->nodes, (unsigned long long) stats->elapsed_us,
+            (seconds > 0) ? (double) result->nodes / seconds : 0.0);
+    for (int depth = 1; depth <= result->depth; depth++) {
+        fprintf(file, "%s%llu", (depth > 1) ? ", " : "", (unsigned long long) stats->depth_nodes[depth]);
+    }
+    fprintf(file, "], \"branching_factor\": %.3f, \"cutoffs\": %llu, \"first_move_cutoff_rate\": %.4f, "
+                  "\"tt_probes\": %llu, \"tt_hits\": %llu, \"tb_hits\": %llu, \"qnodes\": %llu, \"peak_kb\": %ld}\n",
+            stats->branching_factor, (unsigned long long) stats->cutoffs,
+            (stats->cutoffs > 0) ? (double) stats->first_move_cutoffs / (double) stats->cutoffs : 0.0,
+            (unsigned long long) stats->tt_probes, (unsigned long long) stats->tt_hits,
+            (unsigned long long) stats->tb_hits, (unsigned long long) stats->qnodes, stats->peak_memory_kb);
+    fflush(file);
+}
+
+void ai_set_stats_log(FILE* file) {
+    stats_log = file;
+}
+
+const SearchResult* ai_last_result(void) {
+    return &last_result;
+}
+
+void ai_move(Game* game, int depth) {
+    SearchLimits limits = {depth, 0, NULL, NULL};
+    make_ai_move(game, &limits);
+}
+
+void ai_move_timed(Game* game, uint32_t time_ms) {
+    SearchLimits limits = {0, time_ms, NULL, NULL};
+    make_ai_move(game, &limits);
+}
+
+static void* async_search_main(void* arg) {
+    AiSearch* search = arg;
+    search->result = think(&search->board, &search->limits);
+    atomic_store(&search->done, true);
+    if (search->callback != NULL) search->callback(&search->result, search->user_data);
+    return NULL;
+}
+
+AiSearch* ai_search_start(const Game* game, int max_depth, uint32_t time_ms,
+                          AiSearchCallback callback, void* user_data) {
+    AiSearch* search = malloc(sizeof(AiSearch));
+    if (search == NULL) return NULL;
+    board_from_game(&search->board, game);
+    search->limits = (SearchLimits) {max_depth, time_ms, &search->cancel, NULL};
+    atomic_init(&search->cancel, false);
+    atomic_init(&search->done, false);
+    search->callback = callback;
+    search->user_data = user_data;
+    if (pthread_create(&search->thread, NULL, async_search_main, search) != 0) {
+        free(search);
+        return NULL;
+    }
+    return search;
+}
+
+bool ai_search_poll(const AiSearch* search) {
+    return atomic_load(&search->done);
+}
+
+void ai_search_cancel(AiSearch* search) {
+    atomic_store(&search->cancel, true);
+}
+
+bool ai_search_finish(AiSearch* search, Game* game) {
+    pthread_join(search->thread, NULL);
+    SearchResult result = search->result;
+    free(search);
+    play_result(game, &result);
+    return result.has_move;
+}
+
+void ai_search_free(AiSearch* search) {
+    if (search == NULL) return;
+    ai_search_cancel(search);
+    pthread_join(search->thread, NULL);
+    free(search);
+}
@@ -1,20 +1,208 @@
 #ifndef CHECKERS_V2_AI_H
 #define CHECKERS_V2_AI_H
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "game.h"
-#include "vector.h"
+#include "bitboard.h"
 
-typedef enum {MIN, MAX} MinMax;
+#define WIN_SCORE 10000 // score of won position, minus number of plies it takes to win
+#define MAX_PLY 128
+#define DEFAULT_HASH_MB 16 // transposition table size
+#define DEFAULT_THREADS 1
+#define DEFAULT_MCTS_PLAYOUTS 20000 // playouts of Monte Carlo tree search per move, when it has no time limit
+#define MAX_THREADS 64
 
-typedef struct Node {
-    Game game;
-    int8_t value; // heuristic value
-    vector children; // vector of Nodes
-} Node;
+typedef struct SearchOptions {
+    bool pvs;        // principal variation search: moves after the first one are searched with null window
+    bool aspiration; // aspiration windows: each iteration starts with narrow window around previous score
+    bool lmr;        // late move reductions: late quiet moves are searched with reduced depth first
+    bool lazy_smp;   // with more threads: helpers search the whole root at staggered depths instead of splitting root moves
+    bool nnue;       // evaluate with network loaded by ai_load_nnue (find_val if there is none)
+    bool mcts;       // computer moves by Monte Carlo tree search (mcts.h) instead of alpha-beta (off by default)
+    bool mcts_prior; // MCTS: moves with better static evaluation are tried first and more (PUCT instead of UCT)
+} SearchOptions;
 
-void create_tree(Node* root, int depth);
+typedef struct SearchLimits {
+    int max_depth;       // 0 means no depth limit
+    uint32_t time_ms;    // wall-clock budget, 0 means no time limit
+    atomic_bool* cancel; // optional, search stops within about a millisecond after it becomes true
+    atomic_bool* ponder; // optional, time limit doesn't apply while it is true (time is still counted from start)
+} SearchLimits;
+
+// what one search did, counters are of all threads together
+typedef struct SearchStats {
+    uint64_t depth_nodes[MAX_PLY + 1]; // [depth] nodes iteration of that depth took (with lazy_smp main thread only)
+    double branching_factor;     // effective: depth_nodes of last iteration / depth_nodes of the one before
+    uint64_t cutoffs;            // beta cutoffs
+    uint64_t first_move_cutoffs; // cutoffs by first move searched (the higher share, the better move ordering)
+    uint64_t tt_probes;
+    uint64_t tt_hits;
+    uint64_t tb_hits;            // positions found in endgame tablebase
+    uint64_t qnodes;             // quiescence search nodes (they are counted in nodes too)
+    uint64_t elapsed_us;
+    long peak_memory_kb;         // peak resident memory of the process so far
+} SearchStats;
+
+typedef struct SearchResult {
+    BoardMove move; // best move for player to move
+    int score;      // from the point of view of player to move
+    int depth;      // depth of the last completed iteration
+    bool has_move;  // false if player has no legal moves
+    bool from_book; // move was taken from opening book, nothing was searched
+    uint64_t nodes; // positions visited (by all threads)
+    int threads;    // threads that took part in search
+    uint64_t thread_nodes[MAX_THREADS]; // positions visited by each thread, [0] is the thread that called search
+    SearchStats stats;
+} SearchResult;
+
+typedef void (*AiSearchCallback)(const SearchResult* result, void* user_data);
+
+// computer's move searched in background thread, see ai_search_start
+typedef struct AiSearch {
+    pthread_t thread;
+    Board board;          // position being searched
+    SearchLimits limits;
+    atomic_bool cancel;
+    atomic_bool done;
+    SearchResult result;  // valid once done is true
+    AiSearchCallback callback;
+    void* user_data;
+} AiSearch;
+
+/*
+ * Depth-first alpha-beta (negamax) search of given depth
+ * board is used as working position and is unchanged when function returns
+ */
+SearchResult search(Board* board, int depth);
+
+/*
+ * True if search score is a won or lost game (found by search or in endgame tablebase)
+ */
+bool ai_is_known_result(int score);
+
+/*
+ * Iterative deepening: searches depth 1, 2, 3... until depth or time limit is reached or search is cancelled
+ * result comes from the last iteration that was completed
+ */
+SearchResult search_iterative(Board* board, const SearchLimits* limits);
+
+/*
+ * Switches search techniques on or off (all are on by default), takes effect on next search
+ */
+void ai_set_options(const SearchOptions* options);
+SearchOptions ai_get_options(void);
+
+/*
+ * Sets transposition table size in megabytes, table is reallocated (and cleared) before next search.
+ * Monte Carlo tree search takes its node pool of the same size
+ */
+void ai_set_hash_size(size_t megabytes);
+
+/*
+ * Playouts Monte Carlo tree search makes per move in ai_move (it has no depth, depth argument is ignored),
+ * 0 means DEFAULT_MCTS_PLAYOUTS. ai_move_timed searches until time is up
+ */
+void ai_set_mcts_playouts(uint64_t playouts);
+
+/*
+ * Sets number of threads search uses (1 = single-threaded, at most MAX_THREADS), takes effect on next search
+ * with more threads root moves are searched in parallel on a work-stealing thread pool,
+ * or, with lazy_smp option, helper threads search the whole tree sharing the transposition table
+ */
+void ai_set_threads(int threads);
+int ai_get_threads(void);
+
+/*
+ * Static value of position (material and piece placement, see eval.h), positive if white (human) is ahead.
+ * it is kept in the board by make/unmake, so this is a field read
+ */
+int find_val(const Board* board);
+
+/*
+ * Loads endgame tablebase made by tbgen, search then plays positions with few pieces perfectly
+ * false if file can't be read (previous tablebase, if any, stays), don't call while computer is thinking
+ */
+bool ai_load_tablebase(const char* path);
+
+/*
+ * Loads opening book made by bookgen, computer plays its moves without searching
+ * false if file can't be read (previous book, if any, stays), don't call while computer is thinking
+ */
+bool ai_load_book(const char* path);
+
+/*
+ * Loads evaluation network made by nnuetrain, search then evaluates positions with it instead of find_val
+ * (unless nnue option is off). false if file can't be read (previous network, if any, stays),
+ * don't call while computer is thinking
+ */
+bool ai_load_nnue(const char* path);
+
+/*
+ * Result of the last search ai_move or ai_move_timed made (move, score, depth, node counts per thread)
+ */
+const SearchResult* ai_last_result(void);
+
+/*
+ * Writes result and statistics of search as one line of JSON
+ */
+void ai_write_stats_json(FILE* file, const SearchResult* result);
+
+/*
+ * Every computer move (ai_move, ai_move_timed, ai_search_start) is logged to file as one JSON line,
+ * NULL (default) turns logging off
+ */
+void ai_set_stats_log(FILE* file);
 
 void ai_move_dumb(Game* game);
 void ai_move(Game* game, int depth);
-void set_child_values(Node* root, int depth, MinMax minmax);
+
+/*
+ * Makes computer move, thinking for about time_ms milliseconds
+ */
+void ai_move_timed(Game* game, uint32_t time_ms);
+
+/*
+ * Pondering: game is position with human to move. computer guesses human's move and starts
+ * searching its reply in background thread. if human plays that move, next ai_move_timed
+ * with the same time_ms continues this search (and usually answers at once),
+ * otherwise pondering is cancelled and ai_move_timed searches as usual, reusing the transposition table.
+ * does nothing if there is no expected move
+ */
+void ai_ponder_start(const Game* game, uint32_t time_ms);
+
+/*
+ * Cancels pondering (call before game state is thrown away)
+ */
+void ai_ponder_stop(void);
+bool ai_is_pondering(void);
+
+/*
+ * Asynchronous computer move: starts searching computer's move in game (same limits as search_iterative,
+ * 0 = no limit) on a worker thread and returns at once. game is not touched until ai_search_finish.
+ * callback (can be NULL) is called from worker thread when search is done. returns NULL on failure
+ */
+AiSearch* ai_search_start(const Game* game, int max_depth, uint32_t time_ms,
+                          AiSearchCallback callback, void* user_data);
+
+/*
+ * True when search is done (ai_search_finish won't block)
+ */
+bool ai_search_poll(const AiSearch* search);
+
+/*
+ * Asks search to stop as soon as possible, move of the last completed iteration is used
+ */
+void ai_search_cancel(AiSearch* search);
+
+/*
+ * Waits for search, makes computer move in game and frees search. false if computer had no move
+ */
+bool ai_search_finish(AiSearch* search, Game* game);
+
+/*
+ * Cancels search (if still running), waits for it and frees it without making the move
+ */
+void ai_search_free(AiSearch* search);
 
 #endif //CHECKERS_V2_AI_H
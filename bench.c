@@ -0,0 +1,196 @@
+/*
+ * Engine benchmark
+ * ----------------
+ * usage: bench [-d depth] [-m milliseconds] [-t threads] [-h hash MB] [-n network] [-j]
+ *
+ * searches every built-in position (openings, middlegames, endgames) twice: to fixed depth
+ * (time-to-depth) and for fixed time (depth reached), and prints nodes, nodes per second, best move
+ * and peak memory of every search (resident memory of the whole process, peak is reset before every search
+ * where the kernel allows it), as text or, with -j, as JSON.
+ * transposition table is cleared before every search, so runs are reproducible (with one thread).
+ * -n evaluates with network file (nnue.h) instead of find_val
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "ai.h"
+
+#define DEFAULT_DEPTH 18
+#define DEFAULT_TIME_MS 1000
+
+typedef struct BenchPosition {
+    const char* name;
+    const char* position; // text form (see bitboard.h)
+} BenchPosition;
+
+typedef struct BenchRun {
+    SearchResult result;
+    double seconds;
+    long peak_kb;         // peak resident memory of the process during search
+} BenchRun;
+
+static const BenchPosition positions[] = {
+    {"start",                "b:bbbbbbbbbbbb........wwwwwwwwwwww"},
+    {"opening 1",            "b:bbbbbbbbb....bbw....ww..wwwwwwww"},
+    {"opening 2",            "b:bbbbb.bbbbbb....w.w.w..ww.wwwwww"},
+    {"opening 3",            "b:bb.bbbbbbb...b.ww...w.w.w..wwwww"},
+    {"middlegame 1",         "b:...bbw.b.bbb....ww.b.....w.bww.w"},
+    {"middlegame 2",         "b:b....wb..bbb..b.w...w..ww..ww..w"},
+    {"middlegame 3",         "b:..W.b.b.bb....bb....ww.w.wwww..."},
+    {"endgame men vs kings", "b:.W................bbw.b..bB...B."},
+    {"endgame kings",        "b:...W....w.W.......w..B...B......"},
+    {"endgame white moves",  "w:.WW.........w.....b.......BwB..."},
+};
+#define POSITION_COUNT (int) (sizeof(positions) / sizeof(positions[0]))
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// true if peak resident memory starts again from current one (Linux 4.0 and later)
+static bool reset_peak_memory(void) {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file == NULL) return false;
+    bool reset = fputs("5", file) >= 0;
+    return fclose(file) == 0 && reset;
+}
+
+// peak since last reset_peak_memory, or of the whole run if there is none
+static long peak_memory_kb(void) {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file != NULL) {
+        char line[256];
+        long kb = -1;
+        while (kb < 0 && fgets(line, sizeof(line), file) != NULL) {
+            if (sscanf(line, "VmHWM: %ld kB", &kb) != 1) kb = -1;
+        }
+        fclose(file);
+        if (kb >= 0) return kb;
+    }
+    struct rusage usage;
+    return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+static BenchRun run(const Board* position, int depth, uint32_t time_ms, size_t hash_mb) {
+    ai_set_hash_size(hash_mb); // fresh table
+    Board board = *position;
+    SearchLimits limits = {depth, time_ms, NULL, NULL};
+    BenchRun bench_run;
+    reset_peak_memory();
+    double start = now_seconds();
+    bench_run.result = search_iterative(&board, &limits);
+    bench_run.seconds = now_seconds() - start;
+    bench_run.peak_kb = peak_memory_kb();
+    return bench_run;
+}
+
+static double nps(const BenchRun* bench_run) {
+    return (bench_run->seconds > 0) ? (double) bench_run->result.nodes / bench_run->seconds : 0.0;
+}
+
+static void print_text(int index, const BenchRun* fixed_depth, const BenchRun* fixed_time) {
+    char depth_move[BOARD_MOVE_STRING_SIZE] = "", time_move[BOARD_MOVE_STRING_SIZE] = "";
+    if (fixed_depth->result.has_move) board_move_to_string(&fixed_depth->result.move, depth_move);
+    if (fixed_time->result.has_move) board_move_to_string(&fixed_time->result.move, time_move);
+    long peak_kb = (fixed_depth->peak_kb > fixed_time->peak_kb) ? fixed_depth->peak_kb : fixed_time->peak_kb;
+    printf("%-22s depth %2d: %10llu nodes %8.3fs %9.0f nps  %-6s %6d | %5.0fms: depth %2d %10llu nodes %9.0f nps  %-6s %6d | %ld KB\n",
+           positions[index].name,
+           fixed_depth->result.depth, (unsigned long long) fixed_depth->result.nodes, fixed_depth->seconds,
+           nps(fixed_depth), depth_move, fixed_depth->result.score,
+           fixed_time->seconds * 1000, fixed_time->result.depth, (unsigned long long) fixed_time->result.nodes,
+           nps(fixed_time), time_move, fixed_time->result.score, peak_kb);
+}
+
+static void print_json_run(const char* name, const BenchRun* bench_run) {
+    char move[BOARD_MOVE_STRING_SIZE];
+    board_move_to_string(&bench_run->result.move, move);
+    const SearchStats* stats = &bench_run->result.stats;
+    printf("\"%s\": {\"depth\": %d, \"nodes\": %llu, \"seconds\": %.6f, \"nps\": %.0f, \"move\": \"%s\", \"score\": %d, \"peak_kb\": %ld, "
+           "\"branching_factor\": %.3f, \"first_move_cutoff_rate\": %.4f, \"tt_hit_rate\": %.4f, \"qnodes\": %llu}",
+           name, bench_run->result.depth, (unsigned long long) bench_run->result.nodes, bench_run->seconds,
+           nps(bench_run), bench_run->result.has_move ? move : "", bench_run->result.score, bench_run->peak_kb,
+           stats->branching_factor,
+           (stats->cutoffs > 0) ? (double) stats->first_move_cutoffs / (double) stats->cutoffs : 0.0,
+           (stats->tt_probes > 0) ? (double) stats->tt_hits / (double) stats->tt_probes : 0.0,
+           (unsigned long long) stats->qnodes);
+}
+
+static void print_json(int index, const BenchRun* fixed_depth, const BenchRun* fixed_time) {
+    printf("    {\"name\": \"%s\", \"position\": \"%s\", ", positions[index].name, positions[index].position);
+    print_json_run("fixed_depth", fixed_depth);
+    printf(", ");
+    print_json_run("fixed_time", fixed_time);
+    printf("}%s\n", (index + 1 < POSITION_COUNT) ? "," : "");
+}
+
+int main(int argc, char* argv[]) {
+    int depth = DEFAULT_DEPTH;
+    uint32_t time_ms = DEFAULT_TIME_MS;
+    int threads = 1;
+    size_t hash_mb = DEFAULT_HASH_MB;
+    bool json = false;
+    const char* network = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) time_ms = (uint32_t) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) hash_mb = (size_t) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) network = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0) json = true;
+        else {
+            fprintf(stderr, "usage: %s [-d depth] [-m milliseconds] [-t threads] [-h hash MB] [-n network] [-j]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (depth < 1 || depth >= MAX_PLY || time_ms == 0 || hash_mb == 0) {
+        fprintf(stderr, "depth must be 1..%d, time and hash size positive\n", MAX_PLY - 1);
+        return EXIT_FAILURE;
+    }
+    if (network != NULL && !ai_load_nnue(network)) {
+        fprintf(stderr, "can't load network %s\n", network);
+        return EXIT_FAILURE;
+    }
+    ai_set_threads(threads);
+
+    if (json) {
+        printf("{\n  \"depth\": %d, \"time_ms\": %u, \"threads\": %d, \"hash_mb\": %zu, \"nnue\": %s,\n  \"positions\": [\n",
+               depth, time_ms, ai_get_threads(), hash_mb, (network != NULL) ? "true" : "false");
+    } else {
+        printf("fixed depth %d, fixed time %ums, %d thread(s), %zu MB hash, %s evaluation\n", depth, time_ms,
+               ai_get_threads(), hash_mb, (network != NULL) ? "network" : "find_val");
+    }
+    uint64_t total_nodes = 0;
+    double total_seconds = 0;
+    long total_peak_kb = 0; // largest of all searches
+    for (int i = 0; i < POSITION_COUNT; i++) {
+        Board board;
+        if (!board_from_string(&board, positions[i].position)) {
+            fprintf(stderr, "bad built-in position %s\n", positions[i].name);
+            return EXIT_FAILURE;
+        }
+        BenchRun fixed_depth = run(&board, depth, 0, hash_mb);
+        BenchRun fixed_time = run(&board, 0, time_ms, hash_mb);
+        total_nodes += fixed_depth.result.nodes;
+        total_seconds += fixed_depth.seconds;
+        if (fixed_depth.peak_kb > total_peak_kb) total_peak_kb = fixed_depth.peak_kb;
+        if (fixed_time.peak_kb > total_peak_kb) total_peak_kb = fixed_time.peak_kb;
+        if (json) print_json(i, &fixed_depth, &fixed_time);
+        else print_text(i, &fixed_depth, &fixed_time);
+        fflush(stdout);
+    }
+
+    // totals are of fixed depth searches, they do the same work on every machine
+    double total_nps = (total_seconds > 0) ? (double) total_nodes / total_seconds : 0.0;
+    if (json) {
+        printf("  ],\n  \"total\": {\"nodes\": %llu, \"seconds\": %.6f, \"nps\": %.0f, \"peak_kb\": %ld}\n}\n",
+               (unsigned long long) total_nodes, total_seconds, total_nps, total_peak_kb);
+    } else {
+        printf("total: %llu nodes in %.3fs, %.0f nps, peak memory %ld KB\n",
+               (unsigned long long) total_nodes, total_seconds, total_nps, total_peak_kb);
+    }
+    return EXIT_SUCCESS;
+}
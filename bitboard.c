@@ -0,0 +1,281 @@
+#include "bitboard.h"
+#include "zobrist.h"
+#include "eval.h"
+#include "scan.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EVEN_ROWS 0x0F0F0F0Fu // rows 0, 2, 4, 6 (dark cells on odd columns)
+#define ODD_ROWS  0xF0F0F0F0u // rows 1, 3, 5, 7 (dark cells on even columns)
+#define LEFT_COL  0x10101010u // column 0
+#define RIGHT_COL 0x08080808u // column 7
+#define WHITE_PROMOTION_ROW 0x0000000Fu
+#define BLACK_PROMOTION_ROW 0xF0000000u
+
+// diagonal directions on the bitboard (from whites perspective, same as Direction)
+typedef enum {dir_up_left, dir_up_right, dir_down_left, dir_down_right} BoardDirection;
+
+// shifts every piece in mask one step in given direction, pieces that leave the board disappear
+static inline Bitboard shift(Bitboard b, BoardDirection dir) {
+    switch (dir) {
+        case dir_up_left:    return ((b & EVEN_ROWS) >> 4) | ((b & ODD_ROWS & ~LEFT_COL) >> 5);
+        case dir_up_right:   return ((b & EVEN_ROWS & ~RIGHT_COL) >> 3) | ((b & ODD_ROWS) >> 4);
+        case dir_down_left:  return ((b & EVEN_ROWS) << 4) | ((b & ODD_ROWS & ~LEFT_COL) << 3);
+        case dir_down_right: return ((b & EVEN_ROWS & ~RIGHT_COL) << 5) | ((b & ODD_ROWS) << 4);
+    }
+    return 0;
+}
+
+static inline BoardDirection opposite(BoardDirection dir) {
+    return (BoardDirection) (3 - dir);
+}
+
+static inline int lowest_square(Bitboard b) {
+    return __builtin_ctz(b);
+}
+
+static inline int popcount(Bitboard b) {
+    return __builtin_popcount(b);
+}
+
+static inline void add_move(BoardMoveList* moves, uint8_t from, uint8_t dest, bool promotes, Bitboard captured) {
+    assert(moves->count < MAX_BOARD_MOVES);
+    BoardMove* move = &moves->moves[moves->count++];
+    move->from = from;
+    move->dest = dest;
+    move->promotes = promotes;
+    move->captured = captured;
+}
+
+// pieces of player to move that are allowed to move in given direction
+static inline Bitboard movers(const Board* board, BoardDirection dir) {
+    bool up = (dir == dir_up_left || dir == dir_up_right);
+    if (board->current_player == human) {
+        return up ? board->white : (board->white & board->kings);
+    }
+    return up ? (board->black & board->kings) : board->black;
+}
+
+void board_from_game(Board* board, const Game* game) {
+    CellMasks masks;
+    scan_cells(game, &masks);
+    board->white = scan_cells_to_squares(scan_player_cells(&masks, human));
+    board->black = scan_cells_to_squares(scan_player_cells(&masks, computer));
+    board->kings = scan_cells_to_squares(cell_mask(&masks, white_king) | cell_mask(&masks, black_king));
+    board->current_player = game->current_player;
+    board->key = board_key(board);
+    board->value = board_value(board);
+}
+
+void board_to_game(const Board* board, Game* game) {
+    memset(game->board, no_piece, sizeof(game->board));
+    for (int sq = 0; sq < SQUARE_COUNT; sq++) {
+        Bitboard bit = 1u << sq;
+        int8_t piece = no_piece;
+        if (board->white & bit) piece = (board->kings & bit) ? white_king : white;
+        else if (board->black & bit) piece = (board->kings & bit) ? black_king : black;
+        game->board[square_row(sq)][square_col(sq)] = piece;
+    }
+    game->current_player = board->current_player;
+    game->key = board->key;
+    game->pieces[human] = (uint8_t) popcount(board->white);
+    game->pieces[computer] = (uint8_t) popcount(board->black);
+    game->kings[human] = (uint8_t) popcount(board->white & board->kings);
+    game->kings[computer] = (uint8_t) popcount(board->black & board->kings);
+    game->value = board->value;
+}
+
+bool board_from_string(Board* board, const char* text) {
+    if (strlen(text) != BOARD_STRING_SIZE - 1 || (text[0] != 'w' && text[0] != 'b') || text[1] != ':') return false;
+    board->white = board->black = board->kings = 0;
+    board->current_player = (text[0] == 'w') ? human : computer;
+    for (int sq = 0; sq < SQUARE_COUNT; sq++) {
+        Bitboard bit = 1u << sq;
+        switch (text[2 + sq]) {
+            case 'W': board->kings |= bit; // fall through
+            case 'w': board->white |= bit; break;
+            case 'B': board->kings |= bit; // fall through
+            case 'b': board->black |= bit; break;
+            case '.': break;
+            default: return false;
+        }
+    }
+    board->key = board_key(board);
+    board->value = board_value(board);
+    return true;
+}
+
+void board_to_string(const Board* board, char* text) {
+    text[0] = (board->current_player == human) ? 'w' : 'b';
+    text[1] = ':';
+    for (int sq = 0; sq < SQUARE_COUNT; sq++) {
+        Bitboard bit = 1u << sq;
+        char piece = '.';
+        if (board->white & bit) piece = 'w';
+        if (board->black & bit) piece = 'b';
+        if (board->kings & bit) piece -= 'a' - 'A';
+        text[2 + sq] = piece;
+    }
+    text[BOARD_STRING_SIZE - 1] = '\0';
+}
+
+void board_move_to_string(const BoardMove* move, char* text) {
+    snprintf(text, BOARD_MOVE_STRING_SIZE, "%d%c%d", move->from + 1, move->captured ? 'x' : '-', move->dest + 1);
+}
+
+// kind (as in zobrist and evaluation tables) of piece standing on occupied square
+static inline ZobristPiece piece_kind(const Board* board, int sq) {
+    ZobristPiece man = ((board->white >> sq) & 1) ? zobrist_white_man : zobrist_black_man;
+    return ((board->kings >> sq) & 1) ? man + 1 : man;
+}
+
+uint64_t board_key(const Board* board) {
+    zobrist_init();
+    uint64_t key = (board->current_player == computer) ? zobrist_side : 0;
+    for (Bitboard pieces = board->white | board->black; pieces; pieces &= pieces - 1) {
+        int sq = lowest_square(pieces);
+        key ^= zobrist_pieces[piece_kind(board, sq)][sq];
+    }
+    return key;
+}
+
+int16_t board_value(const Board* board) {
+    int value = 0;
+    for (Bitboard pieces = board->white | board->black; pieces; pieces &= pieces - 1) {
+        int sq = lowest_square(pieces);
+        value += piece_square_value[piece_kind(board, sq)][sq];
+    }
+    return (int16_t) value;
+}
+
+bool board_has_captures(const Board* board) {
+    Bitboard opponents = (board->current_player == human) ? board->black : board->white;
+    Bitboard empty = ~(board->white | board->black);
+    for (BoardDirection dir = dir_up_left; dir <= dir_down_right; dir++) {
+        if (shift(shift(movers(board, dir), dir) & opponents, dir) & empty) return true;
+    }
+    return false;
+}
+
+/*
+ * Follows jump path of piece standing on sq, appends move for every complete path.
+ * captured pieces are removed immediately (same as move_piece), so their squares are empty
+ * for the rest of the path. man that reaches last row is crowned and its move ends there.
+ */
+static void add_jumps(uint8_t from, int sq, bool king, bool white_piece,
+                      Bitboard opponents, Bitboard empty, Bitboard captured, BoardMoveList* moves) {
+    Bitboard bit = 1u << sq;
+    Bitboard promotion_row = white_piece ? WHITE_PROMOTION_ROW : BLACK_PROMOTION_ROW;
+    bool jumped = false;
+    for (BoardDirection dir = dir_up_left; dir <= dir_down_right; dir++) {
+        bool up = (dir == dir_up_left || dir == dir_up_right);
+        if (!king && up != white_piece) continue; // men move forward only
+        Bitboard over = shift(bit, dir) & opponents;
+        Bitboard land = shift(over, dir) & empty;
+        if (land == 0) continue;
+        jumped = true;
+        if (!king && (land & promotion_row)) {
+            add_move(moves, from, (uint8_t) lowest_square(land), true, captured | over);
+            continue;
+        }
+        add_jumps(from, lowest_square(land), king, white_piece, opponents & ~over,
+                  (empty | bit | over) & ~land, captured | over, moves);
+    }
+    if (!jumped && captured != 0) {
+        add_move(moves, from, (uint8_t) sq, false, captured);
+    }
+}
+
+void board_moves(const Board* board, BoardMoveList* moves) {
+    moves->count = 0;
+    bool white_to_move = (board->current_player == human);
+    Bitboard own = white_to_move ? board->white : board->black;
+    Bitboard opponents = white_to_move ? board->black : board->white;
+    Bitboard empty = ~(board->white | board->black);
+
+    if (board_has_captures(board)) {
+        for (Bitboard pieces = own; pieces; pieces &= pieces - 1) {
+            int sq = lowest_square(pieces);
+            bool king = (board->kings >> sq) & 1;
+            add_jumps((uint8_t) sq, sq, king, white_to_move, opponents, empty | (1u << sq), 0, moves);
+        }
+        return;
+    }
+
+    Bitboard promotion_row = white_to_move ? WHITE_PROMOTION_ROW : BLACK_PROMOTION_ROW;
+    for (BoardDirection dir = dir_up_left; dir <= dir_down_right; dir++) {
+        for (Bitboard dests = shift(movers(board, dir), dir) & empty; dests; dests &= dests - 1) {
+            Bitboard dest = dests & -dests;
+            Bitboard from = shift(dest, opposite(dir));
+            bool promotes = (dest & promotion_row) && !(board->kings & from);
+            add_move(moves, (uint8_t) lowest_square(from), (uint8_t) lowest_square(dest), promotes, 0);
+        }
+    }
+}
+
+void make_move(Board* board, const BoardMove* move, Undo* undo) {
+    Bitboard from = 1u << move->from;
+    Bitboard dest = 1u << move->dest;
+    bool king = (board->kings & from) || move->promotes;
+    undo->captured = move->captured;
+    undo->captured_kings = board->kings & move->captured;
+    undo->promoted = move->promotes;
+    undo->previous_player = board->current_player;
+    undo->previous_key = board->key;
+    undo->previous_value = board->value;
+
+    bool white_to_move = (board->current_player == human);
+    ZobristPiece man = white_to_move ? zobrist_white_man : zobrist_black_man;
+    ZobristPiece opponent_man = white_to_move ? zobrist_black_man : zobrist_white_man;
+    ZobristPiece before = (board->kings & from) ? man + 1 : man;
+    ZobristPiece after = king ? man + 1 : man;
+    uint64_t key = board->key ^ zobrist_side ^ zobrist_pieces[before][move->from] ^ zobrist_pieces[after][move->dest];
+    int value = board->value - piece_square_value[before][move->from] + piece_square_value[after][move->dest];
+    for (Bitboard taken = move->captured; taken; taken &= taken - 1) {
+        int sq = lowest_square(taken);
+        ZobristPiece kind = ((board->kings >> sq) & 1) ? opponent_man + 1 : opponent_man;
+        key ^= zobrist_pieces[kind][sq];
+        value -= piece_square_value[kind][sq];
+    }
+    board->key = key;
+    board->value = (int16_t) value;
+
+    if (white_to_move) {
+        board->white = (board->white & ~from) | dest;
+        board->black &= ~move->captured;
+    } else {
+        board->black = (board->black & ~from) | dest;
+        board->white &= ~move->captured;
+    }
+    board->kings &= ~(from | move->captured);
+    if (king) board->kings |= dest;
+    board->current_player = white_to_move ? computer : human;
+}
+
+void unmake_move(Board* board, const BoardMove* move, const Undo* undo) {
+    Bitboard from = 1u << move->from;
+    Bitboard dest = 1u << move->dest;
+    bool king = (board->kings & dest) && !undo->promoted;
+    if (undo->previous_player == human) {
+        board->white = (board->white & ~dest) | from;
+        board->black |= undo->captured;
+    } else {
+        board->black = (board->black & ~dest) | from;
+        board->white |= undo->captured;
+    }
+    board->kings = (board->kings & ~dest) | undo->captured_kings;
+    if (king) board->kings |= from;
+    board->current_player = undo->previous_player;
+    board->key = undo->previous_key;
+    board->value = undo->previous_value;
+}
+
+void apply_move(Board* board, const BoardMove* move) {
+    Undo undo;
+    make_move(board, move, &undo);
+}
+
+int board_pieces_count(const Board* board, Player player) {
+    return popcount(player == human ? board->white : board->black);
+}
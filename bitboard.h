@@ -0,0 +1,132 @@
+#ifndef CHECKERS_V2_BITBOARD_H
+#define CHECKERS_V2_BITBOARD_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "game.h"
+
+/*
+ * 32-square bitboard representation used by the AI
+ * -------------------------------------------------
+ * only dark cells ((row + col) is odd) can hold a piece, so the board has 32 playable squares.
+ * square index = row * 4 + col / 2, i.e. squares are numbered row by row from the top
+ * (computer's side) of the board, left to right:
+ *
+ *      .  0  .  1  .  2  .  3      row 0 (black starts here, white promotes here)
+ *      4  .  5  .  6  .  7  .      row 1
+ *      .  8  .  9  . 10  . 11      row 2
+ *     12  . 13  . 14  . 15  .      row 3
+ *      . 16  . 17  . 18  . 19      row 4
+ *     20  . 21  . 22  . 23  .      row 5
+ *      . 24  . 25  . 26  . 27      row 6
+ *     28  . 29  . 30  . 31  .      row 7 (white starts here, black promotes here)
+ *
+ * bit n of a mask is set if square n is occupied.
+ */
+
+#define SQUARE_COUNT 32
+#define square_of(row, col) ((row) * 4 + (col) / 2)
+#define square_row(sq) ((sq) / 4)
+#define square_col(sq) ((((sq) / 4) % 2 == 0) ? ((sq) % 4) * 2 + 1 : ((sq) % 4) * 2)
+
+typedef uint32_t Bitboard;
+
+typedef struct Board {
+    Bitboard white;  // white (human) men and kings
+    Bitboard black;  // black (computer) men and kings
+    Bitboard kings;  // kings of both colors
+    Player current_player;
+    uint64_t key;    // zobrist key (same as Game key of this position), updated by make/unmake
+    int16_t value;   // material and positional value (same as Game value), updated by make/unmake
+} Board;
+
+typedef struct BoardMove {
+    uint8_t from;
+    uint8_t dest;
+    bool promotes;     // man is crowned at the end of this move
+    Bitboard captured; // squares of all pieces taken by this move (whole multi-jump), 0 for regular move
+} BoardMove;
+
+// upper bound on legal moves in a position, multi-jump paths included
+#define MAX_BOARD_MOVES 128
+
+typedef struct BoardMoveList {
+    int count;
+    BoardMove moves[MAX_BOARD_MOVES];
+} BoardMoveList;
+
+// everything make_move changes that can't be recovered from the move itself
+typedef struct Undo {
+    Bitboard captured;       // squares of taken pieces
+    Bitboard captured_kings; // which of the taken pieces were kings
+    bool promoted;           // moving man was crowned
+    Player previous_player;
+    uint64_t previous_key;
+    int16_t previous_value;
+} Undo;
+
+/*
+ * Converts game state to bitboard representation (and back)
+ * board_to_game does not touch game status
+ */
+void board_from_game(Board* board, const Game* game);
+void board_to_game(const Board* board, Game* game);
+
+/*
+ * Text form of position: side to move ('w' human, 'b' computer), ':' and 32 squares in square order,
+ * w/b men, W/B kings, '.' empty. starting position is b:bbbbbbbbbbbb........wwwwwwwwwwww
+ * board_from_string returns false if text is not a position, text needs BOARD_STRING_SIZE chars
+ */
+#define BOARD_STRING_SIZE (2 + SQUARE_COUNT + 1)
+bool board_from_string(Board* board, const char* text);
+void board_to_string(const Board* board, char* text);
+
+/*
+ * Move in standard notation: squares numbered 1..32 (square + 1), '-' for moves, 'x' for jumps, e.g. 9-13
+ */
+#define BOARD_MOVE_STRING_SIZE 8
+void board_move_to_string(const BoardMove* move, char* text);
+
+/*
+ * Computes zobrist key of position from scratch
+ */
+uint64_t board_key(const Board* board);
+
+/*
+ * Computes value of position (sum of piece_square_value of its pieces, see eval.h) from scratch
+ */
+int16_t board_value(const Board* board);
+
+/*
+ * Fills list with all legal moves for the player to move.
+ * if player has jump move only jumps are returned,
+ * multi-jumps are expanded: every complete jump path is a separate move
+ */
+void board_moves(const Board* board, BoardMoveList* moves);
+
+/*
+ * Returns true if player to move has a jump move (and therefore must jump)
+ */
+bool board_has_captures(const Board* board);
+
+/*
+ * Makes move on the board in place and switches player (assumes move is legal)
+ * fills undo record, that unmake_move uses to restore the board
+ */
+void make_move(Board* board, const BoardMove* move, Undo* undo);
+
+/*
+ * Takes back move made by make_move, undo must be the record make_move filled for this move
+ */
+void unmake_move(Board* board, const BoardMove* move, const Undo* undo);
+
+/*
+ * Makes move when there is no need to take it back
+ */
+void apply_move(Board* board, const BoardMove* move);
+
+/*
+ * Number of pieces player has on the board
+ */
+int board_pieces_count(const Board* board, Player player);
+
+#endif //CHECKERS_V2_BITBOARD_H
@@ -0,0 +1,87 @@
+#include "book.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static bool valid_file(const uint8_t* map, size_t size) {
+    if (size < sizeof(BookFileHeader)) return false;
+    const BookFileHeader* header = (const BookFileHeader*) map;
+    if (memcmp(header->magic, BOOK_MAGIC, 4) != 0 || header->version != BOOK_VERSION) return false;
+    return (size - sizeof(BookFileHeader)) / sizeof(BookEntry) == header->entry_count;
+}
+
+Book* book_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // mapping stays valid
+    if (map == MAP_FAILED) return NULL;
+
+    Book* book = malloc(sizeof(Book));
+    if (book == NULL || !valid_file(map, st.st_size)) {
+        free(book);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    book->map = map;
+    book->map_size = st.st_size;
+    book->header = (const BookFileHeader*) book->map;
+    book->entries = (const BookEntry*) (book->map + sizeof(BookFileHeader));
+    return book;
+}
+
+void book_close(Book* book) {
+    if (book == NULL) return;
+    munmap((void*) book->map, book->map_size);
+    free(book);
+}
+
+const BookEntry* book_find(const Book* book, uint64_t key) {
+    uint32_t low = 0;
+    uint32_t high = book->header->entry_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (book->entries[middle].key < key) low = middle + 1;
+        else high = middle;
+    }
+    return (low < book->header->entry_count && book->entries[low].key == key) ? &book->entries[low] : NULL;
+}
+
+bool book_probe(const Book* book, const Board* board, BoardMove* move, int* score) {
+    const BookEntry* entry = book_find(book, board->key);
+    if (entry == NULL) return false;
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    for (int i = 0; i < moves.count; i++) {
+        const BoardMove* candidate = &moves.moves[i];
+        if (candidate->from == entry->from && candidate->dest == entry->dest && candidate->captured == entry->captured) {
+            *move = *candidate;
+            *score = entry->score;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_entries(const void* lhs, const void* rhs) {
+    uint64_t a = ((const BookEntry*) lhs)->key;
+    uint64_t b = ((const BookEntry*) rhs)->key;
+    return (a > b) - (a < b);
+}
+
+bool book_write(const char* path, BookEntry* entries, uint32_t count, int depth) {
+    qsort(entries, count, sizeof(BookEntry), compare_entries);
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+    BookFileHeader header = {{0}, BOOK_VERSION, (uint32_t) depth, count};
+    memcpy(header.magic, BOOK_MAGIC, 4);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(entries, sizeof(BookEntry), count, file) == count;
+    return (fclose(file) == 0) && ok;
+}
@@ -0,0 +1,63 @@
+#ifndef CHECKERS_V2_BOOK_H
+#define CHECKERS_V2_BOOK_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "bitboard.h"
+
+/*
+ * Opening book
+ * ------------
+ * computer's moves in positions of the opening, found offline by deep search (see bookgen).
+ * file (native byte order) is BookFileHeader followed by entries sorted by zobrist key of position,
+ * it is mmap'ed and looked up by binary search, so opening moves cost nothing.
+ * key can collide, move of entry is only played if it's legal in the position
+ */
+
+#define BOOK_MAGIC "CKBK"
+#define BOOK_VERSION 2
+
+typedef struct BookFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t depth;        // depth every position was searched to
+    uint32_t entry_count;
+} BookFileHeader;
+
+typedef struct BookEntry {
+    uint64_t key;          // position, with computer to move
+    Bitboard captured;     // move: squares it takes (tells apart multi-jumps with same ends)
+    uint8_t from;
+    uint8_t dest;
+    int16_t score;         // search score of position
+} BookEntry;
+
+typedef struct Book {
+    const uint8_t* map;
+    size_t map_size;
+    const BookFileHeader* header;
+    const BookEntry* entries;
+} Book;
+
+/*
+ * Opens book file, NULL if it can't be read or isn't a book
+ */
+Book* book_open(const char* path);
+void book_close(Book* book);
+
+/*
+ * Entry of position with given key, NULL if book doesn't have it
+ */
+const BookEntry* book_find(const Book* book, uint64_t key);
+
+/*
+ * Book move of position (one of board_moves), false if position isn't in book
+ */
+bool book_probe(const Book* book, const Board* board, BoardMove* move, int* score);
+
+/*
+ * Writes book file, entries are sorted in place, false on error
+ */
+bool book_write(const char* path, BookEntry* entries, uint32_t count, int depth);
+
+#endif //CHECKERS_V2_BOOK_H
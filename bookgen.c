@@ -0,0 +1,126 @@
+/*
+ * Opening book builder
+ * --------------------
+ * usage: bookgen <plies> <search depth> <output file> [threads] [hash MB]
+ *
+ * walks opening tree from the starting position up to given number of plies: in positions with computer
+ * to move it searches to given depth and follows only the move it found (computer always plays book move),
+ * in positions with human to move it follows every move. positions reached by several move orders are
+ * searched once. found moves are written to book file (see book.h)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ai.h"
+#include "book.h"
+#include "vector.h"
+
+#define PROGRESS_INTERVAL 100 // searched positions between progress lines
+
+// set of position keys already walked, open addressing
+typedef struct KeySet {
+    uint64_t* keys; // 0 is empty slot
+    uint64_t capacity;
+    uint64_t count;
+} KeySet;
+
+typedef struct Builder {
+    int plies;
+    int depth;
+    KeySet walked;
+    vector entries; // of BookEntry
+    double start;
+} Builder;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static bool key_set_insert(KeySet* set, uint64_t key);
+
+static void key_set_grow(KeySet* set) {
+    KeySet bigger = {calloc(set->capacity * 2, sizeof(uint64_t)), set->capacity * 2, 0};
+    if (bigger.keys == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < set->capacity; i++) {
+        if (set->keys[i] != 0) key_set_insert(&bigger, set->keys[i]);
+    }
+    free(set->keys);
+    *set = bigger;
+}
+
+// false if key was in set already
+static bool key_set_insert(KeySet* set, uint64_t key) {
+    if (key == 0) key = 1; // 0 marks empty slots
+    if (2 * (set->count + 1) > set->capacity) key_set_grow(set);
+    uint64_t slot = key & (set->capacity - 1);
+    while (set->keys[slot] != 0) {
+        if (set->keys[slot] == key) return false;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->keys[slot] = key;
+    set->count++;
+    return true;
+}
+
+static void walk(Builder* builder, Board* board, int ply) {
+    if (ply >= builder->plies || !key_set_insert(&builder->walked, board->key)) return;
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    if (moves.count == 0) return;
+
+    if (board->current_player == computer) {
+        SearchResult result = search(board, builder->depth);
+        BookEntry entry = {board->key, result.move.captured, result.move.from, result.move.dest, (int16_t) result.score};
+        VectorAppend(&builder->entries, &entry);
+        if (VectorLength(&builder->entries) % PROGRESS_INTERVAL == 0) {
+            printf("%d positions searched (%.0fs)\n", VectorLength(&builder->entries), now_seconds() - builder->start);
+            fflush(stdout);
+        }
+        Undo undo;
+        make_move(board, &result.move, &undo);
+        walk(builder, board, ply + 1);
+        unmake_move(board, &result.move, &undo);
+        return;
+    }
+    for (int i = 0; i < moves.count; i++) {
+        Undo undo;
+        make_move(board, &moves.moves[i], &undo);
+        walk(builder, board, ply + 1);
+        unmake_move(board, &moves.moves[i], &undo);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <plies> <search depth> <output file> [threads] [hash MB]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    Builder builder = {atoi(argv[1]), atoi(argv[2]), {NULL, 0, 0}, {0}, now_seconds()};
+    if (builder.plies < 1 || builder.depth < 1 || builder.depth >= MAX_PLY) {
+        fprintf(stderr, "plies and search depth must be positive, depth less than %d\n", MAX_PLY);
+        return EXIT_FAILURE;
+    }
+    ai_set_threads((argc > 4) ? atoi(argv[4]) : 1);
+    ai_set_hash_size((argc > 5) ? (size_t) atoi(argv[5]) : 256);
+
+    builder.walked = (KeySet) {calloc(1024, sizeof(uint64_t)), 1024, 0};
+    VectorNew(&builder.entries, sizeof(BookEntry), NULL, 1024);
+    Game game;
+    init_game(&game);
+    Board board;
+    board_from_game(&board, &game);
+    walk(&builder, &board, 0);
+
+    int count = VectorLength(&builder.entries);
+    bool ok = book_write(argv[3], count > 0 ? VectorNth(&builder.entries, 0) : NULL, (uint32_t) count, builder.depth);
+    if (ok) printf("%s: %d positions, depth %d (%.0fs)\n", argv[3], count, builder.depth, now_seconds() - builder.start);
+    else fprintf(stderr, "can't write %s\n", argv[3]);
+    VectorDispose(&builder.entries);
+    free(builder.walked.keys);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
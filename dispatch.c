@@ -0,0 +1,40 @@
+#include "dispatch.h"
+#include <string.h>
+
+bool cpu_any(void) {
+    return true;
+}
+
+#if DISPATCH_X86
+bool cpu_has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+bool cpu_has_avx512bw(void) {
+    return __builtin_cpu_supports("avx512bw");
+}
+#endif
+
+static const KernelHeader* entry(const KernelTable* table, int index) {
+    return (const KernelHeader*) ((const char*) table->entries + (size_t) index * table->entry_size);
+}
+
+const void* kernel_current(KernelTable* table) {
+    const void* current = atomic_load_explicit(&table->current, memory_order_acquire);
+    if (current != NULL) return current;
+    for (int i = 0; current == NULL; i++) {
+        if (entry(table, i)->supported()) current = entry(table, i);
+    }
+    atomic_store_explicit(&table->current, current, memory_order_release);
+    return current;
+}
+
+bool kernel_select(KernelTable* table, const char* name) {
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(entry(table, i)->name, name) == 0 && entry(table, i)->supported()) {
+            atomic_store_explicit(&table->current, entry(table, i), memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
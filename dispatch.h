@@ -0,0 +1,55 @@
+#ifndef CHECKERS_V2_DISPATCH_H
+#define CHECKERS_V2_DISPATCH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Runtime kernel dispatch
+ * -----------------------
+ * modules with SIMD kernels (scan.c, nnue.c) list them in a table, fastest first, portable one last.
+ * every entry is the module's own struct that starts with KernelHeader (name and whether CPU can run it).
+ * first kernel CPU supports is picked at first use, another one can be set by name (for benchmarks and tests)
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISPATCH_X86 1
+#else
+#define DISPATCH_X86 0
+#endif
+
+typedef struct KernelHeader {
+    const char* name;
+    bool (*supported)(void);
+} KernelHeader;
+
+typedef struct KernelTable {
+    const void* entries;          // KernelHeader at start of every entry
+    int count;
+    size_t entry_size;
+    _Atomic(const void*) current; // entry in use, NULL until first use
+} KernelTable;
+
+#define KERNEL_TABLE(entries) {(entries), (int) (sizeof(entries) / sizeof((entries)[0])), sizeof((entries)[0]), NULL}
+
+/*
+ * CPU checks for KernelHeader.supported
+ */
+bool cpu_any(void);
+#if DISPATCH_X86
+bool cpu_has_avx2(void);
+bool cpu_has_avx512bw(void);
+#endif
+
+/*
+ * Entry in use, picks it at first call (threads that get there together pick the same one)
+ */
+const void* kernel_current(KernelTable* table);
+
+/*
+ * Uses kernel with given name from now on, false if there is none or CPU can't run it.
+ * not synchronized with kernels running in other threads, call it before starting them
+ */
+bool kernel_select(KernelTable* table, const char* name);
+
+#endif //CHECKERS_V2_DISPATCH_H
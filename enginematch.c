@@ -0,0 +1,146 @@
+/*
+ * Engine match
+ * ------------
+ * usage: enginematch [-g game pairs] [-m milliseconds per move] [-d depth] [-p playouts] [-t threads] [-u]
+ *
+ * plays alpha-beta against Monte Carlo tree search through ai_move_timed (or, with -m 0, ai_move with
+ * depth for alpha-beta and playouts for MCTS), the entry point the game uses. every opening (a few random
+ * first plies, fixed seed) is played twice with colors swapped. prints wins, losses and draws and the CPU
+ * time each engine used (all threads), so strength can be compared per CPU-second. -u: MCTS without prior
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ai.h"
+
+#define DEFAULT_PAIRS 20
+#define DEFAULT_TIME_MS 100
+#define DEFAULT_DEPTH 8
+#define RANDOM_PLIES 4
+#define MAX_GAME_PLIES 200 // longer games are draws
+#define MATCH_SEED 2024u
+
+typedef enum {alpha_beta, monte_carlo} Engine;
+
+typedef struct Settings {
+    uint32_t time_ms;  // 0: fixed depth and playouts
+    int depth;
+    uint64_t playouts;
+} Settings;
+
+typedef struct Tally {
+    int wins[2];       // [Engine]
+    int draws;
+    double cpu_seconds[2];
+    int moves[2];
+    uint64_t nodes[2];
+} Tally;
+
+static double cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static uint32_t next_random(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static void use_engine(Engine engine) {
+    SearchOptions options = ai_get_options();
+    options.mcts = (engine == monte_carlo);
+    ai_set_options(&options);
+}
+
+// plays game from opening, black (computer side, moves first) is played by engine black_engine
+static void play_game(const Game* opening, Engine black_engine, const Settings* settings, Tally* tally) {
+    Game game = *opening;
+    for (int ply = 0; ply < MAX_GAME_PLIES; ply++) {
+        Board board;
+        board_from_game(&board, &game);
+        BoardMoveList moves;
+        board_moves(&board, &moves);
+        Engine engine = (game.current_player == computer) ? black_engine : !black_engine;
+        if (moves.count == 0) {
+            // same rules as game loop: no pieces lose, no moves is a draw
+            if (board_pieces_count(&board, board.current_player) == 0) tally->wins[!engine]++;
+            else tally->draws++;
+            return;
+        }
+        use_engine(engine);
+        double start = cpu_seconds();
+        if (settings->time_ms != 0) ai_move_timed(&game, settings->time_ms);
+        else ai_move(&game, settings->depth);
+        tally->cpu_seconds[engine] += cpu_seconds() - start;
+        tally->moves[engine]++;
+        tally->nodes[engine] += ai_last_result()->nodes;
+    }
+    tally->draws++;
+}
+
+int main(int argc, char* argv[]) {
+    int pairs = DEFAULT_PAIRS;
+    Settings settings = {DEFAULT_TIME_MS, DEFAULT_DEPTH, DEFAULT_MCTS_PLAYOUTS};
+    int threads = 1;
+    bool prior = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) pairs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) settings.time_ms = (uint32_t) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) settings.depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) settings.playouts = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-u") == 0) prior = false;
+        else {
+            fprintf(stderr, "usage: %s [-g game pairs] [-m milliseconds per move] [-d depth] [-p playouts] [-t threads] [-u]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (pairs < 1 || settings.depth < 1 || settings.depth >= MAX_PLY || settings.playouts == 0) {
+        fprintf(stderr, "game pairs, depth and playouts must be positive, depth less than %d\n", MAX_PLY);
+        return EXIT_FAILURE;
+    }
+    ai_set_threads(threads);
+    ai_set_mcts_playouts(settings.playouts);
+    SearchOptions options = ai_get_options();
+    options.mcts_prior = prior;
+    ai_set_options(&options);
+    if (settings.time_ms != 0) {
+        printf("%d game pairs, %ums per move, %d thread(s)\n", pairs, settings.time_ms, ai_get_threads());
+    } else {
+        printf("%d game pairs, alpha-beta depth %d, MCTS %llu playouts, %d thread(s)\n", pairs, settings.depth,
+               (unsigned long long) settings.playouts, ai_get_threads());
+    }
+
+    Tally tally = {0};
+    uint32_t state = MATCH_SEED;
+    for (int pair = 0; pair < pairs; pair++) {
+        Game opening;
+        init_game(&opening);
+        Board board;
+        board_from_game(&board, &opening);
+        for (int ply = 0; ply < RANDOM_PLIES; ply++) {
+            BoardMoveList moves;
+            board_moves(&board, &moves);
+            if (moves.count == 0) break;
+            apply_move(&board, &moves.moves[next_random(&state) % moves.count]);
+        }
+        board_to_game(&board, &opening);
+        play_game(&opening, alpha_beta, &settings, &tally);
+        play_game(&opening, monte_carlo, &settings, &tally);
+        printf("after %d pairs: alpha-beta %d, MCTS %d, draws %d\n", pair + 1, tally.wins[alpha_beta],
+               tally.wins[monte_carlo], tally.draws);
+        fflush(stdout);
+    }
+
+    const char* names[2] = {"alpha-beta", "MCTS"};
+    for (int e = alpha_beta; e <= monte_carlo; e++) {
+        printf("%-10s %3d wins, %7.2f CPU s, %6.1f ms per move, %12llu nodes\n", names[e], tally.wins[e],
+               tally.cpu_seconds[e], tally.moves[e] > 0 ? tally.cpu_seconds[e] * 1000.0 / tally.moves[e] : 0.0,
+               (unsigned long long) tally.nodes[e]);
+    }
+    printf("draws      %3d\n", tally.draws);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#include "eval.h"
+
+#define MAN(bonus) (MAN_VALUE + (bonus))
+#define KING(bonus) (KING_VALUE + (bonus))
+
+// rows of 4 squares, top (row 0) to bottom (row 7), as in bitboard.h
+const int16_t piece_square_value[4][32] = {
+    // white man: advanced men are closer to crowning, men on back row keep opponent from crowning
+    // (row 0 is never reached, man is crowned there)
+    {
+          MAN(0),   MAN(0),   MAN(0),   MAN(0),
+         MAN(10),  MAN(10),  MAN(10),  MAN(10),
+          MAN(8),   MAN(8),   MAN(8),   MAN(8),
+          MAN(6),   MAN(6),   MAN(6),   MAN(6),
+          MAN(4),   MAN(4),   MAN(4),   MAN(4),
+          MAN(2),   MAN(2),   MAN(2),   MAN(2),
+          MAN(0),   MAN(0),   MAN(0),   MAN(0),
+          MAN(4),   MAN(4),   MAN(4),   MAN(4)
+    },
+    // white king: center squares reach the most of the board
+    {
+         KING(0),  KING(0),  KING(0),  KING(0),
+         KING(0),  KING(3),  KING(3),  KING(3),
+         KING(3),  KING(6),  KING(6),  KING(0),
+         KING(0),  KING(6),  KING(6),  KING(3),
+         KING(3),  KING(6),  KING(6),  KING(0),
+         KING(0),  KING(6),  KING(6),  KING(3),
+         KING(3),  KING(3),  KING(3),  KING(0),
+         KING(0),  KING(0),  KING(0),  KING(0)
+    },
+    // black man: white man's values seen from the other side of the board, negated
+    {
+         -MAN(4),  -MAN(4),  -MAN(4),  -MAN(4),
+         -MAN(0),  -MAN(0),  -MAN(0),  -MAN(0),
+         -MAN(2),  -MAN(2),  -MAN(2),  -MAN(2),
+         -MAN(4),  -MAN(4),  -MAN(4),  -MAN(4),
+         -MAN(6),  -MAN(6),  -MAN(6),  -MAN(6),
+         -MAN(8),  -MAN(8),  -MAN(8),  -MAN(8),
+        -MAN(10), -MAN(10), -MAN(10), -MAN(10),
+         -MAN(0),  -MAN(0),  -MAN(0),  -MAN(0)
+    },
+    // black king: same for white king
+    {
+        -KING(0), -KING(0), -KING(0), -KING(0),
+        -KING(0), -KING(3), -KING(3), -KING(3),
+        -KING(3), -KING(6), -KING(6), -KING(0),
+        -KING(0), -KING(6), -KING(6), -KING(3),
+        -KING(3), -KING(6), -KING(6), -KING(0),
+        -KING(0), -KING(6), -KING(6), -KING(3),
+        -KING(3), -KING(3), -KING(3), -KING(0),
+        -KING(0), -KING(0), -KING(0), -KING(0)
+    }
+};
@@ -0,0 +1,20 @@
+#ifndef CHECKERS_V2_EVAL_H
+#define CHECKERS_V2_EVAL_H
+#include <stdint.h>
+
+/*
+ * Evaluation terms
+ * ----------------
+ * every (piece kind, square) pair has a value: material (MAN_VALUE, KING_VALUE) plus small positional bonus.
+ * kinds are ZobristPiece (zobrist.h), squares are numbered as in bitboard.h.
+ * white's values are positive and black's negative, so value of a position is the sum over its pieces,
+ * positive if white (human) is ahead. Game and Board keep that sum up to date as pieces move and are taken
+ * (move_piece, make_move/unmake_move), evaluation does not need to look at the board.
+ */
+
+#define MAN_VALUE 100
+#define KING_VALUE 200
+
+extern const int16_t piece_square_value[4][32];
+
+#endif //CHECKERS_V2_EVAL_H
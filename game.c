@@ -1,6 +1,9 @@
 #include "game.h"
-#include "vector.h"
+#include "zobrist.h"
+#include "eval.h"
+#include "scan.h"
 #include <stdlib.h>
+#include <assert.h>
 
 bool positions_equal(const Position* lhs, const Position* rhs) {
     return lhs->row == rhs->row && lhs->col == rhs->col;
@@ -10,9 +13,99 @@ static bool in_bounds(const Position* pos) {
     return pos->row >= 0 && pos->row < ROW_SIZE && pos->col >= 0 && pos->col < ROW_SIZE;
 }
 
-// checks if the position is occupied by some piece or it's blank
-static Piece piece_at(const Game* game, const Position* pos) {
-    return game->board[pos->row][pos->col];
+/*
+ * Lookup tables indexed by cell (row * COL_SIZE + col) and Direction
+ * ---------------------------------------------------------
+ * destination_cell gives the cell piece lands on, captured_cell gives the cell of the piece
+ * that is taken by a jump. NO_CELL if move leaves the board (or, for captured_cell, is not a jump).
+ * both tables are constant expressions, so they are built by the compiler.
+ */
+#define CELL_COUNT (ROW_SIZE * COL_SIZE)
+#define NO_CELL (-1)
+#define NO_DIRECTION (-1)
+
+#define STEP(r, c, dr, dc) (((r)+(dr)) >= 0 && ((r)+(dr)) < ROW_SIZE && ((c)+(dc)) >= 0 && ((c)+(dc)) < COL_SIZE \
+                            ? ((r)+(dr)) * COL_SIZE + (c)+(dc) : NO_CELL)
+#define JUMP_OVER(r, c, dr, dc) (STEP(r, c, 2*(dr), 2*(dc)) != NO_CELL ? STEP(r, c, dr, dc) : NO_CELL)
+
+// entries follow Direction order: up_left, up_right, jump_up_left, jump_up_right, down_left, ...
+#define DESTINATIONS(r, c) {STEP(r, c, -1, -1), STEP(r, c, -1, 1), STEP(r, c, -2, -2), STEP(r, c, -2, 2), \
+                            STEP(r, c, 1, -1), STEP(r, c, 1, 1), STEP(r, c, 2, -2), STEP(r, c, 2, 2)}
+#define CAPTURES(r, c) {NO_CELL, NO_CELL, JUMP_OVER(r, c, -1, -1), JUMP_OVER(r, c, -1, 1), \
+                        NO_CELL, NO_CELL, JUMP_OVER(r, c, 1, -1), JUMP_OVER(r, c, 1, 1)}
+#define TABLE_ROW(entry, r) entry(r, 0), entry(r, 1), entry(r, 2), entry(r, 3), \
+                            entry(r, 4), entry(r, 5), entry(r, 6), entry(r, 7)
+#define TABLE(entry) {TABLE_ROW(entry, 0), TABLE_ROW(entry, 1), TABLE_ROW(entry, 2), TABLE_ROW(entry, 3), \
+                      TABLE_ROW(entry, 4), TABLE_ROW(entry, 5), TABLE_ROW(entry, 6), TABLE_ROW(entry, 7)}
+
+static const int8_t destination_cell[CELL_COUNT][8] = TABLE(DESTINATIONS);
+static const int8_t captured_cell[CELL_COUNT][8] = TABLE(CAPTURES);
+
+// Direction of move by (dest.row - from.row + 2, dest.col - from.col + 2)
+static const int8_t delta_direction[5][5] = {
+    {jump_up_left, NO_DIRECTION, NO_DIRECTION, NO_DIRECTION, jump_up_right},
+    {NO_DIRECTION, up_left, NO_DIRECTION, up_right, NO_DIRECTION},
+    {NO_DIRECTION, NO_DIRECTION, NO_DIRECTION, NO_DIRECTION, NO_DIRECTION},
+    {NO_DIRECTION, down_left, NO_DIRECTION, down_right, NO_DIRECTION},
+    {jump_down_left, NO_DIRECTION, NO_DIRECTION, NO_DIRECTION, jump_down_right},
+};
+
+#define JUMP_DIRECTIONS ((1u << jump_up_left) | (1u << jump_up_right) | (1u << jump_down_left) | (1u << jump_down_right))
+
+// bit set of Directions piece can move in, indexed by piece - black_king
+static const uint8_t piece_directions[5] = {
+    0xFF, // black_king: everywhere
+    0xF0, // black: down only
+    0x00, // no_piece
+    0x0F, // white: up only
+    0xFF, // white_king: everywhere
+};
+
+// ZobristPiece of piece, indexed by piece - black_king
+static const int8_t zobrist_kind[5] = {zobrist_black_king, zobrist_black_man, -1, zobrist_white_man, zobrist_white_king};
+
+// zobrist number of piece standing on cell (dark cell's square index is cell / 2)
+static inline uint64_t piece_key(int8_t piece, int8_t cell) {
+    return zobrist_pieces[zobrist_kind[piece - black_king]][cell / 2];
+}
+
+// evaluation term of piece standing on cell
+static inline int16_t piece_value(int8_t piece, int8_t cell) {
+    return piece_square_value[zobrist_kind[piece - black_king]][cell / 2];
+}
+
+static inline Player piece_owner(int8_t piece) {
+    return (piece > 0) ? human : computer;
+}
+
+static inline bool piece_is_king(int8_t piece) {
+    return piece == white_king || piece == black_king;
+}
+
+static inline int8_t cell_index(const Position* pos) {
+    return (int8_t) (pos->row * COL_SIZE + pos->col);
+}
+
+static inline int8_t piece_in_cell(const Game* game, int8_t cell) {
+    return ((const int8_t*) game->board)[cell];
+}
+
+// returns direction of move from -> dest, NO_DIRECTION if it's not a diagonal step or jump
+static int8_t move_direction(const Move* move) {
+    int drow = move->dest.row - move->from.row + 2;
+    int dcol = move->dest.col - move->from.col + 2;
+    if (drow < 0 || drow > 4 || dcol < 0 || dcol > 4) return NO_DIRECTION;
+    return delta_direction[drow][dcol];
+}
+
+// checks if piece standing on cell can move in direction (does not check whose turn it is)
+static bool step_is_legal(const Game* game, int8_t cell, int8_t direction) {
+    int8_t piece = piece_in_cell(game, cell);
+    int8_t dest = destination_cell[cell][direction];
+    if (dest == NO_CELL || !(piece_directions[piece - black_king] & (1u << direction))) return false;
+    if (piece_in_cell(game, dest) != no_piece) return false;
+    int8_t over = captured_cell[cell][direction];
+    return over == NO_CELL || piece * piece_in_cell(game, over) < 0; // jumped piece must be opponent's
 }
 
 static void initialize_row(int8_t* row, Piece piece, bool even) {
@@ -24,30 +117,44 @@ static void initialize_row(int8_t* row, Piece piece, bool even) {
     }
 }
 
-void all_moves(const Game* game, Player player, vector* moves) {
+// appends moves of piece standing on pos to the list
+static void add_piece_moves(const Game* game, const Position* pos, MoveList* moves) {
+    int8_t cell = cell_index(pos);
+    for (int8_t direction = up_left; direction <= jump_down_right; direction++) {
+        if (!step_is_legal(game, cell, direction)) continue;
+        int8_t dest = destination_cell[cell][direction];
+        assert(moves->count < MAX_MOVES);
+        Move* move = &moves->moves[moves->count++];
+        move->from = *pos;
+        move->dest.row = dest / COL_SIZE;
+        move->dest.col = dest % COL_SIZE;
+        move->direction = direction;
+    }
+}
+
+void all_moves(const Game* game, Player player, MoveList* moves) {
+    moves->count = 0;
     if (player != computer && player != human) return;
-    Piece pr = (player == human) ? white : black;
-    Piece pk = (player == human) ? white_king : black_king;
-
-    for (int8_t row = 0; row < ROW_SIZE; row++) {
-        for (int8_t col = 0; col < COL_SIZE; col++) {
-            // if piece belongs to this player
-            if (game->board[row][col] == pr || game->board[row][col] == pk) {
-                Position pos = {row, col};
-                vector* piece_moves = all_moves_for_piece(game, &pos);
-                for (int i = 0; i < VectorLength(piece_moves); i++) {
-                    Move* move = VectorNth(piece_moves, i);
-                    VectorAppend(moves, move);
-                }
-                VectorDispose(piece_moves);
-            }
-        }
+    CellMasks masks;
+    scan_cells(game, &masks);
+    // cells of this player's pieces, in row by row order
+    for (uint64_t cells = scan_player_cells(&masks, player); cells; cells &= cells - 1) {
+        int cell = __builtin_ctzll(cells);
+        Position pos = {(int8_t) (cell / COL_SIZE), (int8_t) (cell % COL_SIZE)};
+        if (!player_chooses_wrong_piece(game, &pos)) add_piece_moves(game, &pos, moves);
     }
 }
 
-bool has_jump_move(const vector* moves) {
-    for (int i = 0; i < VectorLength(moves); i++) {
-        if (move_is_jump(VectorNth(moves, i))) return true;
+bool player_has_jump(const Game* game, Player player) {
+    if (player != computer && player != human) return false;
+    CellMasks masks;
+    scan_cells(game, &masks);
+    return scan_has_jump(&masks, player);
+}
+
+bool has_jump_move(const MoveList* moves) {
+    for (int i = 0; i < moves->count; i++) {
+        if (move_is_jump(&moves->moves[i])) return true;
     }
     return false;
 }
@@ -64,193 +171,95 @@ void init_game(struct Game* game) {
 
     game->current_player = computer;
     game->status = RUNNING;
+
+    zobrist_init();
+    game->key = zobrist_side; // computer moves first
+    CellMasks masks;
+    scan_cells(game, &masks);
+    for (Player player = human; player <= computer; player++) {
+        game->pieces[player] = (uint8_t) __builtin_popcountll(scan_player_cells(&masks, player));
+        game->kings[player] = (uint8_t) __builtin_popcountll(cell_mask(&masks, player == human ? white_king : black_king));
+    }
+    game->value = 0;
+    for (uint64_t cells = scan_player_cells(&masks, human) | scan_player_cells(&masks, computer); cells; cells &= cells - 1) {
+        int8_t cell = (int8_t) __builtin_ctzll(cells);
+        int8_t piece = piece_in_cell(game, cell);
+        game->key ^= piece_key(piece, cell);
+        game->value += piece_value(piece, cell);
+    }
 }
 
 Player get_current_player(const Game* game) { return game->current_player; }
 
-vector* all_moves_for_piece(const Game* game, const Position* pos) {
-    int8_t piece = game->board[pos->row][pos->col];
-    if (piece == no_piece) return NULL;
-
-    vector* moves = malloc(sizeof(vector));
-    VectorNew(moves, sizeof(Move), NULL, 4);
-
-    Position pos_ul = {pos->row-1, pos->col-1};
-    Move ul = {*pos, pos_ul, up_left};
-    Position pos_ur = {pos->row-1, pos->col+1};
-    Move ur = {*pos, pos_ur, up_right};
-    Position pos_jul = {pos->row-2, pos->col-2};
-    Move jul = {*pos, pos_jul, jump_up_left};
-    Position pos_jur = {pos->row-2, pos->col+2};
-    Move jur = {*pos, pos_jur, jump_up_right};
-    Position pos_dl = {pos->row+1, pos->col-1};
-    Move dl = {*pos, pos_dl, down_left};
-    Position pos_dr = {pos->row+1, pos->col+1};
-    Move dr = {*pos, pos_dr, down_right};
-    Position pos_jdl = {pos->row+2, pos->col-2};
-    Move jdl = {*pos, pos_jdl, jump_down_left};
-    Position pos_jdr = {pos->row+2, pos->col+2};
-    Move jdr = {*pos, pos_jdr, jump_down_right};
-
-    if (move_is_valid(game, &ul)) VectorAppend(moves, &ul);
-    if (move_is_valid(game, &ur)) VectorAppend(moves, &ur);
-    if (move_is_valid(game, &jul)) VectorAppend(moves, &jul);
-    if (move_is_valid(game, &jur)) VectorAppend(moves, &jur);
-    if (move_is_valid(game, &dl)) VectorAppend(moves, &dl);
-    if (move_is_valid(game, &dr)) VectorAppend(moves, &dr);
-    if (move_is_valid(game, &jdl)) VectorAppend(moves, &jdl);
-    if (move_is_valid(game, &jdr)) VectorAppend(moves, &jdr);
-
-    return moves;
+void all_moves_for_piece(const Game* game, const Position* pos, MoveList* moves) {
+    moves->count = 0;
+    if (player_chooses_wrong_piece(game, pos)) return;
+    add_piece_moves(game, pos, moves);
 }
 
 void move_piece(Game* game, const Move* move) {
     if (!move_is_valid(game, move)) return;
 
+    int8_t from = cell_index(&move->from);
+    int8_t dest = cell_index(&move->dest);
     int8_t piece = game->board[move->from.row][move->from.col];
     game->board[move->from.row][move->from.col] = no_piece;
     game->board[move->dest.row][move->dest.col] = piece;
+    game->key ^= piece_key(piece, from);
+    game->value -= piece_value(piece, from);
 
-    if (move->direction == jump_up_right || move->direction == jump_up_left
-        || move->direction == jump_down_left || move->direction == jump_down_right) {
-
-        switch (move->direction) {
-            case jump_up_left:
-                game->board[move->from.row-1][move->from.col-1] = no_piece; break;
-            case jump_up_right:
-                game->board[move->from.row-1][move->from.col+1] = no_piece; break;
-            case jump_down_left:
-                game->board[move->from.row+1][move->from.col-1] = no_piece; break;
-            case jump_down_right:
-                game->board[move->from.row+1][move->from.col+1] = no_piece; break;
-        }
+    if (move_is_jump(move)) {
+        int8_t over = captured_cell[from][move->direction];
+        int8_t taken = piece_in_cell(game, over);
+        game->key ^= piece_key(taken, over);
+        game->value -= piece_value(taken, over);
+        game->pieces[piece_owner(taken)]--;
+        if (piece_is_king(taken)) game->kings[piece_owner(taken)]--;
+        ((int8_t*) game->board)[over] = no_piece;
     }
 
     // check if this move should make ordinary piece the king
     if (piece == white && move->dest.row == 0) {
         game->board[move->dest.row][move->dest.col] = white_king;
+        game->kings[human]++;
     } else if (piece == black && move->dest.row == ROW_SIZE-1) {
         game->board[move->dest.row][move->dest.col] = black_king;
+        game->kings[computer]++;
     }
+    game->key ^= piece_key(piece_in_cell(game, dest), dest);
+    game->value += piece_value(piece_in_cell(game, dest), dest);
 }
 
 void switch_player(Game* game) {
     game->current_player = (game->current_player == human) ? computer : human;
+    game->key ^= zobrist_side;
 }
 
 bool player_chooses_wrong_piece(const Game* game, const Position* pos) {
     int8_t piece = game->board[pos->row][pos->col];
-    return (piece == black && game->current_player == human) ||
-           (piece == black_king && game->current_player == human) ||
-           (piece == white && game->current_player == computer) ||
-           (piece == white_king && game->current_player == computer) ||
-           (piece == no_piece);
+    // human owns white pieces (positive), computer owns black pieces (negative)
+    return piece == no_piece || (piece > 0) != (game->current_player == human);
 }
 
 bool move_is_valid(const Game* game, const Move* move) {
-    if (in_bounds(&move->from) == false) return false;
-    int8_t piece = game->board[move->from.row][move->from.col];
+    if (!in_bounds(&move->from) || !in_bounds(&move->dest)) return false;
     if (player_chooses_wrong_piece(game, &move->from)) return false;
-    if (!in_bounds(&move->dest)) return false;
-    if (piece_at(game, &move->dest) != no_piece) return false;
-
-    Position pos = move->from;
-    Position pos_ul = {pos.row-1, pos.col-1};
-    Position pos_ur = {pos.row-1, pos.col+1};
-    Position pos_jul = {pos.row-2, pos.col-2};
-    Position pos_jur = {pos.row-2, pos.col+2};
-    Position pos_dl = {pos.row+1, pos.col-1};
-    Position pos_dr = {pos.row+1, pos.col+1};
-    Position pos_jdl = {pos.row+2, pos.col-2};
-    Position pos_jdr = {pos.row+2, pos.col+2};
-
-    if (piece == white || piece == white_king) {
-       if (positions_equal(&move->dest, &pos_ul) || positions_equal(&move->dest, &pos_ur)) {
-           return true; // up left or up right case
-       } else if (piece == white_king && (positions_equal(&move->dest, &pos_dl) || positions_equal(&move->dest, &pos_dr))) {
-           return true; // down left and down right case if piece is white_king
-       } else { // jumps
-           if (positions_equal(&move->dest, &pos_jul) && (piece_at(game, &pos_ul) == black
-                || piece_at(game, &pos_ul) == black_king)) {
-               return true; // jump up left case
-           } else if (positions_equal(&move->dest, &pos_jur) && (piece_at(game, &pos_ur) == black
-                        || piece_at(game, &pos_ur) == black_king)) {
-               return true; // jump up right case
-           } else if (piece == white_king && positions_equal(&move->dest, &pos_jdl) &&
-                        (piece_at(game, &pos_dl) == black || piece_at(game, &pos_dl) == black_king)) {
-              return true; // jump down left case for white_king
-           } else if (piece == white_king && positions_equal(&move->dest, &pos_jdr) &&
-                        (piece_at(game, &pos_dr) == black || piece_at(game, &pos_dr) == black_king)) {
-               return true; // jump down right case for white_king
-           }
-           return false; // none
-       }
-    }
-    // else piece is either black or black_king
-    if (positions_equal(&move->dest, &pos_dl) || positions_equal(&move->dest, &pos_dr)) {
-        return true; // down left or down right case (from whites perspective)
-    } else if (piece == black_king && (positions_equal(&move->dest, &pos_ul) || positions_equal(&move->dest, &pos_ur))) {
-        return true; // up left or up right case if piece is black_king
-    } else { // jumps
-        if (positions_equal(&move->dest, &pos_jdl) && (piece_at(game, &pos_dl) == white
-            || piece_at(game, &pos_dl) == white_king)) {
-            return true; // jump down left case
-        } else if (positions_equal(&move->dest, &pos_jdr) && (piece_at(game, &pos_dr) == white
-                || piece_at(game, &pos_dr) == white_king)) {
-            return true; // jump down right case
-        } else if (piece == black_king && positions_equal(&move->dest, &pos_jul) &&
-                (piece_at(game, &pos_ul) == white || piece_at(game, &pos_ul) == white_king)) {
-            return true; // jump up left case for black_king
-        } else if (piece == black_king && positions_equal(&move->dest, &pos_jur) &&
-                    (piece_at(game, &pos_ur) == white || piece_at(game, &pos_ur) == white_king)) {
-            return true; // jump up right case for black_king
-        }
-    }
-    return false;
+    int8_t direction = move_direction(move);
+    if (direction == NO_DIRECTION) return false;
+    return step_is_legal(game, cell_index(&move->from), direction);
 }
 
 bool move_is_jump(const Move* move) {
-   return move->direction == jump_up_left || move->direction == jump_up_right
-            || move->direction == jump_down_left || move->direction == jump_down_right;
+    return (JUMP_DIRECTIONS >> move->direction) & 1;
 }
 
 void set_move_direction(Move* move) {
-    Position pos = move->from;
-    Position dest = move->dest;
-    Position pos_ul = {pos.row-1, pos.col-1};
-    Position pos_ur = {pos.row-1, pos.col+1};
-    Position pos_jul = {pos.row-2, pos.col-2};
-    Position pos_jur = {pos.row-2, pos.col+2};
-    Position pos_dl = {pos.row+1, pos.col-1};
-    Position pos_dr = {pos.row+1, pos.col+1};
-    Position pos_jdl = {pos.row+2, pos.col-2};
-    Position pos_jdr = {pos.row+2, pos.col+2};
-    if (positions_equal(&dest, &pos_ul)) move->direction = up_left;
-    else if (positions_equal(&dest, &pos_ur)) move->direction = up_right;
-    else if (positions_equal(&dest, &pos_jul)) move->direction = jump_up_left;
-    else if (positions_equal(&dest, &pos_jur)) move->direction = jump_up_right;
-    else if (positions_equal(&dest, &pos_dl)) move->direction = down_left;
-    else if (positions_equal(&dest, &pos_dr)) move->direction = down_right;
-    else if (positions_equal(&dest, &pos_jdl)) move->direction = jump_down_left;
-    else if (positions_equal(&dest, &pos_jdr)) move->direction = jump_down_right;
+    int8_t direction = move_direction(move);
+    if (direction != NO_DIRECTION) move->direction = direction;
 }
 
 uint8_t player_pieces_count(const Game* game, Player player) {
-    uint8_t count = 0;
-    for (int row = 0; row < ROW_SIZE; row++) {
-        for (int col = 0; col < COL_SIZE; col++) {
-            if (player == human) {
-                if (game->board[row][col] == white || game->board[row][col] == white_king) {
-                    count++;
-                }
-            } else {
-                if (game->board[row][col] == black || game->board[row][col] == black_king) {
-                    count++;
-                }
-            }
-        }
-    }
-    return count;
+    return (player == human || player == computer) ? game->pieces[player] : 0;
 }
 
 void print_board(const Game* game) {
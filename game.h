@@ -4,7 +4,6 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
-#include "vector.h"
 
 #define ROW_SIZE 8
 #define COL_SIZE 8
@@ -26,10 +25,23 @@ typedef struct Move {
     Direction direction;
 } Move;
 
+// every piece moves along at most 4 diagonals, 12 pieces * 4 fits with room to spare
+#define MAX_MOVES 64
+
+typedef struct MoveList {
+    int count;
+    Move moves[MAX_MOVES];
+} MoveList;
+
 typedef struct Game {
     int8_t board[8][8];
     Player current_player;
     Status status;
+    uint64_t key; // zobrist key of position (board and player to move), kept up to date by move_piece/switch_player
+    // running counts and evaluation, kept up to date by move_piece (captures and crowning included)
+    uint8_t pieces[2]; // [Player] men and kings player has on the board
+    uint8_t kings[2];  // [Player] kings
+    int16_t value;     // material and positional value, positive if human (white) is ahead (see eval.h)
 } Game;
 
 /*
@@ -38,15 +50,15 @@ typedef struct Game {
 void init_game(Game* game);
 
 /*
- * Returns vector that contains all available moves from current position
- * Gives ownership to caller
+ * Fills list with all available moves for piece on given position
+ * (empty if there is no piece or it belongs to the player who is not on move)
  */
-vector* all_moves_for_piece(const Game* game, const Position* pos);
+void all_moves_for_piece(const Game* game, const Position* pos, MoveList* moves);
 
 /*
- * fills vector with all possible moves for given player
+ * fills list with all possible moves for given player
  */
-void all_moves(const Game* game, Player player, vector* moves);
+void all_moves(const Game* game, Player player, MoveList* moves);
 
 /*
  * Returns true if move is valid
@@ -54,9 +66,14 @@ void all_moves(const Game* game, Player player, vector* moves);
 bool move_is_valid(const Game* game, const Move* move);
 
 /*
- * Returns true if vector contains jump move
+ * Returns true if player has a jump move (and so must jump), without listing moves
  */
-bool has_jump_move(const vector* moves);
+bool player_has_jump(const Game* game, Player player);
+
+/*
+ * Returns true if list contains jump move
+ */
+bool has_jump_move(const MoveList* moves);
 
 /*
  * Moves piece on the board
@@ -80,6 +97,9 @@ bool player_chooses_wrong_piece(const Game* game, const Position* pos);
  */
 void switch_player(Game* game);
 
+/*
+ * Number of pieces (men and kings) player has on the board
+ */
 uint8_t player_pieces_count(const Game* game, Player player);
 
 /*
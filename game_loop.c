@@ -9,8 +9,9 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
     Move move, last_move;
     Position from, dest;
 
-    vector possible_moves; // all possible moves for current player
-    VectorNew(&possible_moves, sizeof(Move), NULL, 8);
+    MoveList possible_moves; // all possible moves for current player
+    AiSearch* search = NULL; // computer's move being searched in background
+    Uint32 computer_turn_start = 0;
 
     SDL_RenderClear(renderer);
     render_game(renderer, game, textures, NULL);
@@ -22,6 +23,7 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
             switch (e.type) {
                 case SDL_QUIT: game->status = QUIT; break;
                 case SDL_MOUSEBUTTONDOWN: {
+                    if (game->current_player != human) break; // ignore clicks while computer thinks
                     if (first_press) {
                         from.row = e.button.y / CELL_WIDTH;
                         from.col = e.button.x / CELL_WIDTH;
@@ -54,19 +56,28 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
 
         // if player has no legal moves, declare draw
         all_moves(game, game->current_player, &possible_moves);
-        if (VectorLength(&possible_moves) == 0) {
-            VectorClear(&possible_moves);
+        if (possible_moves.count == 0) {
             game->status = DRAW;
             continue;
         }
-        VectorClear(&possible_moves);
 
         // (computer vs player mode)
-        // if computers turn, make move; continue
+        // if computers turn, search runs in background while this loop keeps rendering;
+        // move is made when search is done (but not sooner than AI_MOVE_DELAY_MS, so human sees own move)
         if (game->current_player == computer) {
-            SDL_Delay(500);
-            ai_move(game, 7);
+            if (search == NULL) {
+                computer_turn_start = SDL_GetTicks();
+                search = ai_search_start(game, 0, AI_THINK_TIME_MS, NULL, NULL);
+                if (search == NULL) ai_move_timed(game, AI_THINK_TIME_MS); // no thread, think here
+            }
+            if (search != NULL) {
+                if (!ai_search_poll(search) || SDL_GetTicks() - computer_turn_start < AI_MOVE_DELAY_MS) continue;
+                ai_search_finish(search, game);
+                search = NULL;
+            }
             play_audio(device, audio_buffer, len);
+            // think about the next move while human is thinking
+            ai_ponder_start(game, AI_THINK_TIME_MS);
             continue;
         }
 
@@ -82,6 +93,7 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
             move_formed = false;
             continue;
         }
+        int8_t piece = game->board[move.from.row][move.from.col];
         // if multi-jump required
         if (multi_jump_required) {
             // if selected move follows last jump but is not jump or selected move is not jump
@@ -95,10 +107,8 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
         }
         // move is valid now
         // also check if move is not jump but player has jump move (not permitted according to rules)
-        all_moves(game, game->current_player, &possible_moves); // add all possible moves for current player to vector
-        if (has_jump_move(&possible_moves) && !move_is_jump(&move)) {
+        if (!move_is_jump(&move) && player_has_jump(game, game->current_player)) {
             printf("Player must jump\n");
-            VectorClear(&possible_moves);
             first_press = true;
             move_formed = false;
             continue;
@@ -110,18 +120,18 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
 
             move_piece(game, &move);
             // if multi-jumps are possible, don't switch to other player. require player to multi-jump
-            vector* piece_moves = all_moves_for_piece(game, &move.dest);
-            if (has_jump_move(piece_moves)) {
-                VectorDispose(piece_moves);
+            // (unless the piece was just crowned, crowning ends the move)
+            bool crowned = game->board[move.dest.row][move.dest.col] != piece;
+            MoveList piece_moves;
+            all_moves_for_piece(game, &move.dest, &piece_moves);
+            if (!crowned && has_jump_move(&piece_moves)) {
                 printf("Player must multi-jump\n");
                 last_move = move;
                 multi_jump_required = true;
-                VectorClear(&possible_moves);
                 first_press = true;
                 move_formed = false;
                 continue;
             }
-            VectorDispose(piece_moves);
         }
 
         if (!multi_jump_required && !move_is_jump(&move)) {
@@ -131,11 +141,11 @@ void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
         switch_player(game);
         multi_jump_required = false;
 
-        VectorClear(&possible_moves); // clear possible moves for current player
         first_press = true;
         move_formed = false;
     }
-    VectorDispose(&possible_moves);
+    ai_search_free(search);
+    ai_ponder_stop();
     SDL_RenderClear(renderer);
     render_game(renderer, game, textures, NULL); // render board
     SDL_RenderPresent(renderer);
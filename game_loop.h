@@ -5,6 +5,9 @@
 #include "audio.h"
 #include "ai.h"
 
+#define AI_THINK_TIME_MS 1000 // how long computer thinks about its move
+#define AI_MOVE_DELAY_MS 500  // computer never answers sooner than this
+
 void game_loop(Game* game, SDL_Renderer* renderer, Textures* textures,
                SDL_AudioDeviceID device, const Uint8* audio_buffer, Uint32 len);
 
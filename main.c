@@ -2,6 +2,17 @@
 #include "graphics.h"
 #include "audio.h"
 #include "game_loop.h"
+#include "ai.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TABLEBASE_FILE "endgame.tb"
+#define BOOK_FILE "opening.book"
+#define NNUE_FILE "eval.nnue"
+#define STATS_LOG_VARIABLE "CHECKERS_STATS_LOG" // environment variable, file to append search statistics to
+#define ENGINE_VARIABLE "CHECKERS_ENGINE"       // environment variable, "mcts" makes computer use Monte Carlo tree search
 
 int main(int argc, char* argv[]) {
     // initialize graphics
@@ -17,6 +28,25 @@ int main(int argc, char* argv[]) {
     Uint8* audio_buffer;
     SDL_AudioDeviceID audio_device = init_audio(&spec, &len, &audio_buffer);
 
+    // let computer think on every core
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    ai_set_threads(cores > 0 ? (int) cores : 1);
+    // endgame tablebase (made by tbgen), opening book (bookgen) and evaluation network (nnuetrain) are optional,
+    // computer searches without them
+    ai_load_tablebase(TABLEBASE_FILE);
+    ai_load_book(BOOK_FILE);
+    ai_load_nnue(NNUE_FILE);
+    // statistics of every computer move as JSON lines, for tuning and watching think time
+    const char* stats_path = getenv(STATS_LOG_VARIABLE);
+    FILE* stats_log = (stats_path != NULL) ? fopen(stats_path, "a") : NULL;
+    ai_set_stats_log(stats_log);
+    const char* engine = getenv(ENGINE_VARIABLE);
+    if (engine != NULL && strcmp(engine, "mcts") == 0) {
+        SearchOptions options = ai_get_options();
+        options.mcts = true;
+        ai_set_options(&options);
+    }
+
     // initialize game
     Game game;
     init_game(&game);
@@ -25,6 +55,8 @@ int main(int argc, char* argv[]) {
     game_loop(&game, renderer, &textures, audio_device, audio_buffer, len);
 
     // free up memory
+    ai_set_stats_log(NULL);
+    if (stats_log != NULL) fclose(stats_log);
     free_audio(audio_device, audio_buffer);
     free_graphics(&window, &renderer, &textures);
     return EXIT_SUCCESS;
@@ -0,0 +1,292 @@
+#include "mcts.h"
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RESULT_SCALE 1000u      // playout result of a win in node values (draw is half of it)
+#define UCT_EXPLORATION 1.0f
+#define PUCT_EXPLORATION 2.0f
+#define PRIOR_TEMPERATURE 100.0f // find_val difference (a man) that makes move e times more likely
+#define PLAYOUT_PLIES 6         // random plies from leaf, more if captures are pending then
+#define MAX_PLAYOUT_PLIES 40
+#define SCORE_SCALE 200.0f      // find_val score of 73% win probability
+#define MAX_SCORE 3000          // score of surest result, below won game scores of search
+#define STOP_CHECK_INTERVAL 16  // playouts between looks at the clock
+
+typedef struct MctsShared {
+    MctsTree* tree;
+    const Board* board;
+    const MctsLimits* limits;
+    uint64_t deadline;            // monotonic time in ns, 0 if there is no time limit
+    atomic_uint_fast64_t started; // playouts started by all threads
+    atomic_bool stop;
+    atomic_bool full;             // pool has run out, no more expansions
+} MctsShared;
+
+typedef struct MctsWorker {
+    MctsShared* shared;
+    uint64_t random;
+    uint64_t playouts;
+    int max_depth;
+} MctsWorker;
+
+bool mcts_init(MctsTree* tree, size_t megabytes) {
+    size_t capacity = megabytes * 1024 * 1024 / sizeof(MctsNode);
+    if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+    tree->capacity = (uint32_t) capacity;
+    tree->nodes = (capacity > MAX_BOARD_MOVES) ? malloc(capacity * sizeof(MctsNode)) : NULL;
+    atomic_init(&tree->used, 0);
+    return tree->nodes != NULL;
+}
+
+void mcts_free(MctsTree* tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->capacity = 0;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// xorshift64*, every thread has its own state
+static uint32_t next_random(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (uint32_t) ((*state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// find_val from the point of view of player to move
+static int player_value(const Board* board) {
+    int value = find_val(board);
+    return (board->current_player == human) ? value : -value;
+}
+
+// chance that player to move wins position nobody can move in (as at the root of search_iterative)
+static float terminal_result(const Board* board) {
+    return (board_pieces_count(board, board->current_player) == 0) ? 0.0f : 0.5f;
+}
+
+static void init_node(MctsNode* node, const BoardMove* move, float prior) {
+    node->move = *move;
+    node->prior = prior;
+    atomic_init(&node->visits, 0);
+    atomic_init(&node->value, 0);
+    node->first_child = 0;
+    node->child_count = 0;
+    atomic_init(&node->state, mcts_leaf);
+}
+
+// node has to be in mcts_expanding state (taken by this thread), false if pool is full
+static bool expand(MctsShared* shared, MctsNode* node, const Board* board, const BoardMoveList* moves) {
+    MctsTree* tree = shared->tree;
+    uint32_t first = 0;
+    if (moves->count > 0) {
+        first = atomic_fetch_add(&tree->used, (unsigned) moves->count);
+        if ((uint64_t) first + (uint64_t) moves->count > tree->capacity) {
+            atomic_store(&shared->full, true);
+            atomic_store_explicit(&node->state, mcts_leaf, memory_order_release);
+            return false;
+        }
+    }
+    float priors[MAX_BOARD_MOVES];
+    if (shared->limits->prior && moves->count > 0) {
+        // softmax of static evaluation after move, from the point of view of player making it
+        float scores[MAX_BOARD_MOVES];
+        float best = -INFINITY, sum = 0.0f;
+        for (int i = 0; i < moves->count; i++) {
+            Board after = *board;
+            Undo undo;
+            make_move(&after, &moves->moves[i], &undo);
+            scores[i] = (float) -player_value(&after);
+            if (scores[i] > best) best = scores[i];
+        }
+        for (int i = 0; i < moves->count; i++) {
+            priors[i] = expf((scores[i] - best) / PRIOR_TEMPERATURE);
+            sum += priors[i];
+        }
+        for (int i = 0; i < moves->count; i++) priors[i] /= sum;
+    } else {
+        for (int i = 0; i < moves->count; i++) priors[i] = 1.0f / (float) moves->count;
+    }
+    for (int i = 0; i < moves->count; i++) init_node(&tree->nodes[first + i], &moves->moves[i], priors[i]);
+    node->first_child = first;
+    node->child_count = (uint16_t) moves->count;
+    atomic_store_explicit(&node->state, mcts_expanded, memory_order_release);
+    return true;
+}
+
+// mean result of node for player who made its move, virtual losses count as lost playouts
+static float node_mean(unsigned visits, uint64_t value) {
+    return (float) value / ((float) visits * RESULT_SCALE);
+}
+
+static MctsNode* select_child(const MctsShared* shared, MctsNode* node) {
+    MctsNode* children = &shared->tree->nodes[node->first_child];
+    unsigned parent_visits = atomic_load_explicit(&node->visits, memory_order_relaxed);
+    bool prior = shared->limits->prior;
+    float uct_log = logf((float) (parent_visits > 0 ? parent_visits : 1));
+    float puct_sqrt = sqrtf((float) parent_visits);
+    // unvisited children (with prior) are assumed as good as parent is for player to move
+    uint64_t parent_value = atomic_load_explicit(&node->value, memory_order_relaxed);
+    float first_play = (parent_visits > 0) ? 1.0f - node_mean(parent_visits, parent_value) : 0.5f;
+    MctsNode* best = &children[0];
+    float best_score = -INFINITY;
+    for (int i = 0; i < node->child_count; i++) {
+        MctsNode* child = &children[i];
+        unsigned visits = atomic_load_explicit(&child->visits, memory_order_relaxed);
+        uint64_t value = atomic_load_explicit(&child->value, memory_order_relaxed);
+        float score;
+        if (prior) {
+            float mean = (visits > 0) ? node_mean(visits, value) : first_play;
+            score = mean + PUCT_EXPLORATION * child->prior * puct_sqrt / (1.0f + (float) visits);
+        } else {
+            if (visits == 0) return child; // every move is tried once before any twice
+            score = node_mean(visits, value) + UCT_EXPLORATION * sqrtf(uct_log / (float) visits);
+        }
+        if (score > best_score) {
+            best_score = score;
+            best = child;
+        }
+    }
+    return best;
+}
+
+// random moves from board, then static evaluation. chance that player to move at board wins
+static float rollout(MctsWorker* worker, Board* board) {
+    bool flipped = false; // player to move is the other one now
+    for (int ply = 0;; ply++) {
+        BoardMoveList moves;
+        board_moves(board, &moves);
+        float result;
+        if (moves.count == 0) {
+            result = terminal_result(board);
+        } else if ((ply >= PLAYOUT_PLIES && moves.moves[0].captured == 0) || ply >= MAX_PLAYOUT_PLIES) {
+            result = 1.0f / (1.0f + expf(-(float) player_value(board) / SCORE_SCALE));
+        } else {
+            apply_move(board, &moves.moves[next_random(&worker->random) % (uint32_t) moves.count]);
+            flipped = !flipped;
+            continue;
+        }
+        return flipped ? 1.0f - result : result;
+    }
+}
+
+static void playout(MctsWorker* worker) {
+    MctsShared* shared = worker->shared;
+    MctsNode* nodes = shared->tree->nodes;
+    Board board = *shared->board;
+    MctsNode* path[MAX_PLY + 1];
+    int depth = 0;
+    MctsNode* node = &nodes[0];
+    path[0] = node;
+    atomic_fetch_add_explicit(&node->visits, MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+    while (depth < MAX_PLY) {
+        unsigned char state = atomic_load_explicit(&node->state, memory_order_acquire);
+        if (state == mcts_leaf && !atomic_load_explicit(&shared->full, memory_order_relaxed)) {
+            unsigned char expected = mcts_leaf;
+            if (atomic_compare_exchange_strong(&node->state, &expected, mcts_expanding)) {
+                BoardMoveList moves;
+                board_moves(&board, &moves);
+                expand(shared, node, &board, &moves);
+            }
+            break; // new node is scored by playout from it
+        }
+        if (state != mcts_expanded || node->child_count == 0) break;
+        node = select_child(shared, node);
+        atomic_fetch_add_explicit(&node->visits, MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+        apply_move(&board, &node->move);
+        path[++depth] = node;
+    }
+    if (depth > worker->max_depth) worker->max_depth = depth;
+
+    // node's value is for player who made its move, the one not to move in its position
+    float result = 1.0f - rollout(worker, &board);
+    for (int d = depth; d >= 0; d--) {
+        atomic_fetch_add_explicit(&path[d]->value, (uint64_t) (result * RESULT_SCALE + 0.5f), memory_order_relaxed);
+        atomic_fetch_sub_explicit(&path[d]->visits, MCTS_VIRTUAL_LOSS - 1, memory_order_relaxed);
+        result = 1.0f - result;
+    }
+}
+
+static bool should_stop(MctsWorker* worker) {
+    MctsShared* shared = worker->shared;
+    if (atomic_load_explicit(&shared->stop, memory_order_relaxed)) return true;
+    uint64_t started = atomic_fetch_add_explicit(&shared->started, 1, memory_order_relaxed);
+    bool stop = (shared->limits->playouts != 0 && started >= shared->limits->playouts);
+    if (!stop && worker->playouts % STOP_CHECK_INTERVAL == 0) {
+        stop = (shared->limits->cancel != NULL && atomic_load_explicit(shared->limits->cancel, memory_order_relaxed))
+               || (shared->deadline != 0 && now_ns() >= shared->deadline);
+    }
+    if (stop) atomic_store(&shared->stop, true);
+    return stop;
+}
+
+static void run_playouts(void* arg) {
+    MctsWorker* worker = arg;
+    while (!should_stop(worker)) {
+        playout(worker);
+        worker->playouts++;
+    }
+}
+
+SearchResult mcts_search(MctsTree* tree, const Board* board, const MctsLimits* limits, ThreadPool* pool) {
+    uint64_t start = now_ns();
+    SearchResult result = {0};
+    result.threads = 1;
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    if (moves.count == 0) {
+        result.score = (board_pieces_count(board, board->current_player) == 0) ? -WIN_SCORE : 0;
+        return result;
+    }
+    result.has_move = true;
+    result.move = moves.moves[0];
+    if (moves.count == 1 && limits->time_ms != 0) return result; // forced move, nothing to think about
+
+    // tree of previous search is dropped, its root is rarely in this one
+    MctsShared shared = {.tree = tree, .board = board, .limits = limits};
+    shared.deadline = (limits->time_ms != 0) ? start + (uint64_t) limits->time_ms * 1000000u : 0;
+    atomic_init(&shared.started, 0);
+    atomic_init(&shared.stop, false);
+    atomic_init(&shared.full, false);
+    atomic_store(&tree->used, 1);
+    MctsNode* root = &tree->nodes[0];
+    init_node(root, &moves.moves[0], 1.0f);
+    atomic_store(&root->state, mcts_expanding);
+    expand(&shared, root, board, &moves);
+
+    int worker_count = 1 + ((pool != NULL) ? pool->size : 0);
+    MctsWorker workers[MAX_THREADS];
+    for (int i = 0; i < worker_count; i++) {
+        workers[i] = (MctsWorker) {&shared, 0x9E3779B97F4A7C15ull * (uint64_t) (i + 1) ^ start, 0, 0};
+    }
+    TaskGroup group;
+    task_group_init(&group);
+    for (int i = 1; i < worker_count; i++) threadpool_submit(pool, &group, run_playouts, &workers[i]);
+    run_playouts(&workers[0]);
+    if (worker_count > 1) threadpool_wait(pool, &group);
+
+    // most visited move is the one search trusts most
+    MctsNode* children = &tree->nodes[root->first_child];
+    const MctsNode* best = &children[0];
+    for (int i = 1; i < root->child_count; i++) {
+        if (atomic_load(&children[i].visits) > atomic_load(&best->visits)) best = &children[i];
+    }
+    result.move = best->move;
+    unsigned visits = atomic_load(&best->visits);
+    float mean = (visits > 0) ? node_mean(visits, atomic_load(&best->value)) : 0.5f;
+    float score = (mean <= 0.0f || mean >= 1.0f) ? (mean <= 0.0f ? -MAX_SCORE : MAX_SCORE)
+                                                   : SCORE_SCALE * logf(mean / (1.0f - mean));
+    result.score = (int) fmaxf(fminf(score, MAX_SCORE), -MAX_SCORE);
+    result.threads = worker_count;
+    for (int i = 0; i < worker_count; i++) {
+        result.thread_nodes[i] = workers[i].playouts;
+        result.nodes += workers[i].playouts;
+        if (workers[i].max_depth > result.depth) result.depth = workers[i].max_depth;
+    }
+    return result;
+}
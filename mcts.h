@@ -0,0 +1,67 @@
+#ifndef CHECKERS_V2_MCTS_H
+#define CHECKERS_V2_MCTS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "ai.h"
+#include "threadpool.h"
+
+/*
+ * Monte Carlo tree search
+ * -----------------------
+ * every playout walks down the tree choosing children by UCT (or, with prior, by PUCT: children with
+ * better static evaluation after the move are tried first and more), expands the node it stops at and
+ * plays random moves from there for a few plies (until position is quiet), then scores the position
+ * with find_val as win probability and adds it to every node on the way back.
+ *
+ * nodes come from a pool allocated once (MctsTree), children of a node are one block of the pool.
+ * threads run playouts on the same tree without locks: counters are atomic and a playout counts its
+ * visit on the way down (virtual loss), so other threads see the path as worse and spread out.
+ * when the pool is full, tree stops growing and playouts start from its leaves
+ */
+
+#define MCTS_VIRTUAL_LOSS 3 // visits a running playout adds to nodes on its path, as losses
+
+typedef struct MctsNode {
+    BoardMove move;              // move from parent's position to this one
+    float prior;                 // share of parent's playouts move is expected to deserve (with prior)
+    atomic_uint visits;          // finished playouts plus virtual losses of running ones
+    atomic_uint_fast64_t value;  // sum of playout results for player who made move, MCTS_RESULT_SCALE is a win
+    uint32_t first_child;        // index of children block in pool
+    uint16_t child_count;
+    atomic_uchar state;          // mcts_leaf, mcts_expanding or mcts_expanded
+} MctsNode;
+
+enum {
+    mcts_leaf,
+    mcts_expanding,  // a thread is filling children in, others treat node as leaf meanwhile
+    mcts_expanded,   // children are there (none if player to move has no moves)
+};
+
+typedef struct MctsTree {
+    MctsNode* nodes;
+    uint32_t capacity;
+    atomic_uint used;
+} MctsTree;
+
+typedef struct MctsLimits {
+    uint64_t playouts;   // 0 means no playout limit
+    uint32_t time_ms;    // 0 means no time limit
+    atomic_bool* cancel; // optional, search stops within a few playouts after it becomes true
+    bool prior;          // PUCT with static evaluation as prior instead of plain UCT
+} MctsLimits;
+
+/*
+ * Allocates node pool of given size, false if it can't
+ */
+bool mcts_init(MctsTree* tree, size_t megabytes);
+void mcts_free(MctsTree* tree);
+
+/*
+ * Searches board until playout or time limit (one of them must be set), on every thread of pool
+ * (NULL: only calling thread). move is the most visited root move, score is its win probability
+ * in find_val units, depth is the deepest node reached and nodes are playouts
+ */
+SearchResult mcts_search(MctsTree* tree, const Board* board, const MctsLimits* limits, ThreadPool* pool);
+
+#endif //CHECKERS_V2_MCTS_H
@@ -0,0 +1,457 @@
+/*
+ * Microbenchmarks of hot primitives
+ * ---------------------------------
+ * usage: microbench [-s samples] [-p positions] [-k scan kernel] [-n network] [-e nnue kernel] [name ...]
+ *
+ * times every primitive alone over a corpus of positions from random games (fixed seed, so the
+ * corpus is the same in every run). every benchmark is run in samples of at least SAMPLE_NS,
+ * and reported as mean, standard deviation and minimum of ns per call over samples, plus
+ * cycles per call (time stamp counter on x86, which ticks at constant rate, not core clock).
+ * names select benchmarks to run (all of them by default), -k picks kernel of whole-board scans (scan.h)
+ * instead of the one CPU dispatch picks, to compare them, -e does the same for evaluation network (nnue.h).
+ * network benchmarks use -n network file, or a network of zeros (weights don't change how long it takes)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "ai.h"
+#include "vector.h"
+#include "scan.h"
+#include "nnue.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#define DEFAULT_SAMPLES 20
+#define DEFAULT_POSITIONS 4096
+#define SAMPLE_NS 10000000u // 10 ms
+#define CORPUS_SEED 12345u
+#define MAX_GAME_PLIES 200
+
+typedef struct Corpus {
+    int count;
+    Game* games;
+    Board* boards;
+    Move* moves;            // one legal move of every position (first of all_moves)
+    Move* probes;           // move_is_valid input: legal move or random one
+    Position* pieces;       // every piece of player to move, in all positions
+    int* piece_games;       // position each of pieces belongs to
+    int piece_count;
+    BoardMove* board_moves; // every legal move of every position
+    int* move_boards;       // position each of board_moves belongs to
+    int board_move_count;
+} Corpus;
+
+// one pass over corpus, returns number of calls made; sink keeps results alive
+typedef uint64_t (*BenchFunction)(const Corpus* corpus, uint64_t* sink);
+
+typedef struct Benchmark {
+    const char* name;
+    BenchFunction function;
+} Benchmark;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* corpus */
+
+static uint32_t next_random(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static Position cell_position(int row, int col) {
+    Position pos = {(int8_t) row, (int8_t) col};
+    return pos;
+}
+
+static void build_corpus(Corpus* corpus, int count) {
+    corpus->count = count;
+    corpus->games = malloc(count * sizeof(Game));
+    corpus->boards = malloc(count * sizeof(Board));
+    corpus->moves = malloc(count * sizeof(Move));
+    corpus->probes = malloc(count * sizeof(Move));
+    corpus->pieces = malloc(count * 12 * sizeof(Position));
+    corpus->piece_games = malloc(count * 12 * sizeof(int));
+    corpus->piece_count = 0;
+    corpus->board_moves = malloc(count * MAX_BOARD_MOVES * sizeof(BoardMove));
+    corpus->move_boards = malloc(count * MAX_BOARD_MOVES * sizeof(int));
+    corpus->board_move_count = 0;
+    if (corpus->games == NULL || corpus->boards == NULL || corpus->moves == NULL || corpus->probes == NULL
+        || corpus->pieces == NULL || corpus->piece_games == NULL
+        || corpus->board_moves == NULL || corpus->move_boards == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // positions of random games, every one where player to move has a move
+    uint32_t state = CORPUS_SEED;
+    Board board;
+    int ply = MAX_GAME_PLIES;
+    for (int n = 0; n < count;) {
+        BoardMoveList moves;
+        if (ply < MAX_GAME_PLIES) board_moves(&board, &moves);
+        if (ply >= MAX_GAME_PLIES || moves.count == 0) {
+            Game start;
+            init_game(&start);
+            board_from_game(&board, &start);
+            ply = 0;
+            continue;
+        }
+        Game* game = &corpus->games[n];
+        game->status = RUNNING;
+        board_to_game(&board, game);
+        corpus->boards[n] = board;
+
+        MoveList game_moves;
+        all_moves(game, game->current_player, &game_moves);
+        corpus->moves[n] = game_moves.moves[0];
+        Move probe = game_moves.moves[next_random(&state) % game_moves.count];
+        if (next_random(&state) % 2) {
+            // random cells, mostly invalid
+            probe.from = cell_position(next_random(&state) % ROW_SIZE, next_random(&state) % COL_SIZE);
+            probe.dest = cell_position(next_random(&state) % ROW_SIZE, next_random(&state) % COL_SIZE);
+            set_move_direction(&probe);
+        }
+        corpus->probes[n] = probe;
+        for (int row = 0; row < ROW_SIZE; row++) {
+            for (int col = 0; col < COL_SIZE; col++) {
+                Position pos = cell_position(row, col);
+                if (player_chooses_wrong_piece(game, &pos)) continue;
+                corpus->pieces[corpus->piece_count] = pos;
+                corpus->piece_games[corpus->piece_count++] = n;
+            }
+        }
+        for (int i = 0; i < moves.count; i++) {
+            corpus->board_moves[corpus->board_move_count] = moves.moves[i];
+            corpus->move_boards[corpus->board_move_count++] = n;
+        }
+        n++;
+        apply_move(&board, &moves.moves[next_random(&state) % moves.count]);
+        ply++;
+    }
+}
+
+static void free_corpus(Corpus* corpus) {
+    free(corpus->games);
+    free(corpus->boards);
+    free(corpus->moves);
+    free(corpus->probes);
+    free(corpus->pieces);
+    free(corpus->piece_games);
+    free(corpus->board_moves);
+    free(corpus->move_boards);
+}
+
+static Network* network;
+
+/* benchmarks */
+
+static uint64_t bench_all_moves(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        MoveList moves;
+        all_moves(&corpus->games[i], corpus->games[i].current_player, &moves);
+        *sink += moves.count;
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_all_moves_for_piece(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->piece_count; i++) {
+        MoveList moves;
+        all_moves_for_piece(&corpus->games[corpus->piece_games[i]], &corpus->pieces[i], &moves);
+        *sink += moves.count;
+    }
+    return corpus->piece_count;
+}
+
+// includes copying the game, move_piece changes it
+static uint64_t bench_move_piece(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        Game game = corpus->games[i];
+        move_piece(&game, &corpus->moves[i]);
+        *sink += game.key;
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_move_is_valid(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        *sink += move_is_valid(&corpus->games[i], &corpus->probes[i]);
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_find_val(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        *sink += (uint64_t) find_val(&corpus->boards[i]);
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_player_pieces_count(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        *sink += player_pieces_count(&corpus->games[i], corpus->games[i].current_player);
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_scan_cells(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        CellMasks masks;
+        scan_cells(&corpus->games[i], &masks);
+        *sink += cell_mask(&masks, no_piece);
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_player_has_jump(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        *sink += player_has_jump(&corpus->games[i], corpus->games[i].current_player);
+    }
+    return corpus->count;
+}
+
+static uint64_t bench_board_from_game(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        Board board;
+        board_from_game(&board, &corpus->games[i]);
+        *sink += board.key;
+    }
+    return corpus->count;
+}
+
+// accumulators of corpus positions, computed on first use
+static const NnueAccumulator* corpus_accumulators(const Corpus* corpus) {
+    static NnueAccumulator* accumulators = NULL;
+    if (accumulators == NULL) {
+        accumulators = aligned_alloc(_Alignof(NnueAccumulator), corpus->count * sizeof(NnueAccumulator));
+        for (int i = 0; i < corpus->count; i++) nnue_refresh(network, &corpus->boards[i], &accumulators[i]);
+    }
+    return accumulators;
+}
+
+static uint64_t bench_nnue_evaluate(const Corpus* corpus, uint64_t* sink) {
+    const NnueAccumulator* accumulators = corpus_accumulators(corpus);
+    for (int i = 0; i < corpus->count; i++) {
+        *sink += (uint64_t) nnue_evaluate(network, &accumulators[i], corpus->boards[i].current_player);
+    }
+    return corpus->count;
+}
+
+// accumulator after every legal move, what search does instead of nnue_refresh
+static uint64_t bench_nnue_update(const Corpus* corpus, uint64_t* sink) {
+    const NnueAccumulator* accumulators = corpus_accumulators(corpus);
+    for (int i = 0; i < corpus->board_move_count; i++) {
+        int n = corpus->move_boards[i];
+        NnueAccumulator after;
+        nnue_update(network, &accumulators[n], &after, &corpus->boards[n], &corpus->board_moves[i]);
+        *sink += (uint64_t) after.values[human][0];
+    }
+    return corpus->board_move_count;
+}
+
+static uint64_t bench_nnue_refresh(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        NnueAccumulator accumulator;
+        nnue_refresh(network, &corpus->boards[i], &accumulator);
+        *sink += (uint64_t) accumulator.values[human][0];
+    }
+    return corpus->count;
+}
+
+// appends to a vector that starts empty every pass (so growth is part of it), element per position
+static uint64_t bench_vector_append(const Corpus* corpus, uint64_t* sink) {
+    vector v;
+    VectorNew(&v, sizeof(Board), NULL, 4);
+    for (int i = 0; i < corpus->count; i++) VectorAppend(&v, &corpus->boards[i]);
+    *sink += VectorLength(&v);
+    VectorDispose(&v);
+    return corpus->count;
+}
+
+static uint64_t bench_vector_nth(const Corpus* corpus, uint64_t* sink) {
+    static vector v;
+    static bool filled = false;
+    if (!filled) {
+        VectorNew(&v, sizeof(Board), NULL, corpus->count);
+        for (int i = 0; i < corpus->count; i++) VectorAppend(&v, &corpus->boards[i]);
+        filled = true;
+    }
+    for (int i = 0; i < corpus->count; i++) {
+        *sink += ((const Board*) VectorNth(&v, i))->white;
+    }
+    return corpus->count;
+}
+
+// bitboard counterparts the search uses, for comparison
+static uint64_t bench_board_moves(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->count; i++) {
+        BoardMoveList moves;
+        board_moves(&corpus->boards[i], &moves);
+        *sink += moves.count;
+    }
+    return corpus->count;
+}
+
+// make_move and unmake_move of every legal move
+static uint64_t bench_make_unmake(const Corpus* corpus, uint64_t* sink) {
+    for (int i = 0; i < corpus->board_move_count; i++) {
+        Board board = corpus->boards[corpus->move_boards[i]];
+        Undo undo;
+        make_move(&board, &corpus->board_moves[i], &undo);
+        *sink += board.key;
+        unmake_move(&board, &corpus->board_moves[i], &undo);
+        *sink += board.white;
+    }
+    return corpus->board_move_count;
+}
+
+static const Benchmark benchmarks[] = {
+    {"all_moves",           bench_all_moves},
+    {"all_moves_for_piece", bench_all_moves_for_piece},
+    {"move_piece",          bench_move_piece},
+    {"move_is_valid",       bench_move_is_valid},
+    {"find_val",            bench_find_val},
+    {"player_pieces_count", bench_player_pieces_count},
+    {"scan_cells",          bench_scan_cells},
+    {"player_has_jump",     bench_player_has_jump},
+    {"board_from_game",     bench_board_from_game},
+    {"VectorAppend",        bench_vector_append},
+    {"VectorNth",           bench_vector_nth},
+    {"board_moves",         bench_board_moves},
+    {"make_unmake",         bench_make_unmake},
+    {"nnue_evaluate",       bench_nnue_evaluate},
+    {"nnue_update",         bench_nnue_update},
+    {"nnue_refresh",        bench_nnue_refresh},
+};
+#define BENCHMARK_COUNT (int) (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* harness */
+
+// results of every benchmark end up here, a volatile store can't be optimized away and so can't the calls
+static volatile uint64_t published_sink;
+
+static void run_benchmark(const Benchmark* benchmark, const Corpus* corpus, int samples, uint64_t* sink) {
+    uint64_t calls_per_pass = benchmark->function(corpus, sink); // also warms caches up
+    uint64_t start = now_ns();
+    benchmark->function(corpus, sink);
+    uint64_t pass_ns = now_ns() - start;
+    uint64_t passes = (pass_ns >= SAMPLE_NS) ? 1 : SAMPLE_NS / (pass_ns + 1) + 1;
+
+    double sum = 0, sum_squares = 0, best = INFINITY, cycle_sum = 0;
+    for (int s = 0; s < samples; s++) {
+        uint64_t sample_start = now_ns();
+        uint64_t cycle_start = cycles();
+        for (uint64_t p = 0; p < passes; p++) {
+            benchmark->function(corpus, sink);
+            published_sink = *sink;
+        }
+        uint64_t cycle_count = cycles() - cycle_start;
+        double ns = (double) (now_ns() - sample_start) / (double) (passes * calls_per_pass);
+        sum += ns;
+        sum_squares += ns * ns;
+        if (ns < best) best = ns;
+        cycle_sum += (double) cycle_count / (double) (passes * calls_per_pass);
+    }
+    double mean = sum / samples;
+    double variance = (samples > 1) ? (sum_squares - sum * mean) / (samples - 1) : 0.0;
+    printf("%-20s %10.2f %8.2f %10.2f", benchmark->name, mean, sqrt(variance > 0 ? variance : 0), best);
+    if (HAVE_TSC) printf(" %10.1f", cycle_sum / samples);
+    printf(" %12llu\n", (unsigned long long) (passes * calls_per_pass));
+}
+
+int main(int argc, char* argv[]) {
+    int samples = DEFAULT_SAMPLES;
+    int positions = DEFAULT_POSITIONS;
+    bool selected[BENCHMARK_COUNT];
+    bool any_selected = false;
+    memset(selected, 0, sizeof(selected));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            positions = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            if (!scan_set_kernel(argv[++i])) {
+                fprintf(stderr, "scan kernel %s is unknown or not supported by this CPU\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            network = nnue_load(argv[++i]);
+            if (network == NULL) {
+                fprintf(stderr, "can't load network %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            if (!nnue_set_kernel(argv[++i])) {
+                fprintf(stderr, "nnue kernel %s is unknown or not supported by this CPU\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        int found = -1;
+        for (int b = 0; b < BENCHMARK_COUNT; b++) {
+            if (strcmp(argv[i], benchmarks[b].name) == 0) found = b;
+        }
+        if (found < 0) {
+            fprintf(stderr, "usage: %s [-s samples] [-p positions] [-k scan kernel] [-n network] [-e nnue kernel] [name ...]\nbenchmarks:", argv[0]);
+            for (int b = 0; b < BENCHMARK_COUNT; b++) fprintf(stderr, " %s", benchmarks[b].name);
+            fprintf(stderr, "\n");
+            return EXIT_FAILURE;
+        }
+        selected[found] = any_selected = true;
+    }
+    if (samples < 1 || positions < 1) {
+        fprintf(stderr, "samples and positions must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (network == NULL) {
+        network = aligned_alloc(_Alignof(Network), sizeof(Network));
+        if (network == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return EXIT_FAILURE;
+        }
+        memset(network, 0, sizeof(Network)); // only timing matters
+    }
+
+    Corpus corpus;
+    build_corpus(&corpus, positions);
+    printf("%d positions, %d pieces to move, %d samples, %s scan kernel, %s nnue kernel\n", corpus.count,
+           corpus.piece_count, samples, scan_kernel_name(), nnue_kernel_name());
+    printf("%-20s %10s %8s %10s", "benchmark", "ns/call", "stddev", "min");
+    if (HAVE_TSC) printf(" %10s", "tsc/call");
+    printf(" %12s\n", "calls");
+    uint64_t sink = 0;
+    for (int b = 0; b < BENCHMARK_COUNT; b++) {
+        if (!any_selected || selected[b]) run_benchmark(&benchmarks[b], &corpus, samples, &sink);
+    }
+    free_corpus(&corpus);
+    nnue_free(network);
+    return EXIT_SUCCESS;
+}
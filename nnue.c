@@ -0,0 +1,211 @@
+#include "nnue.h"
+#include "zobrist.h"
+#include "eval.h"
+#include "dispatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+#define MAX_CHANGES (2 + SQUARE_COUNT) // pieces a move adds or removes: mover twice plus captured ones
+
+// accumulator after adding and removing weight rows of changed inputs
+typedef void (*AccumulateKernel)(int16_t* out, const int16_t* in, const int16_t* const* added, int added_count,
+                                 const int16_t* const* removed, int removed_count);
+// raw hidden layer sums (before bias) of clipped accumulators
+typedef void (*HiddenKernel)(const Network* network, const int16_t* own, const int16_t* other, int32_t* sums);
+
+typedef struct KernelInfo {
+    KernelHeader header;
+    AccumulateKernel accumulate;
+    HiddenKernel hidden;
+} KernelInfo;
+
+static inline uint8_t clipped(int16_t value) {
+    return (uint8_t) (value < 0 ? 0 : value > NNUE_SCALE_A ? NNUE_SCALE_A : value);
+}
+
+static void accumulate_scalar(int16_t* out, const int16_t* in, const int16_t* const* added, int added_count,
+                              const int16_t* const* removed, int removed_count) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int16_t value = in[i];
+        for (int a = 0; a < added_count; a++) value += added[a][i];
+        for (int r = 0; r < removed_count; r++) value -= removed[r][i];
+        out[i] = value;
+    }
+}
+
+static void hidden_scalar(const Network* network, const int16_t* own, const int16_t* other, int32_t* sums) {
+    uint8_t input[2 * NNUE_HIDDEN];
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        input[i] = clipped(own[i]);
+        input[NNUE_HIDDEN + i] = clipped(other[i]);
+    }
+    for (int j = 0; j < NNUE_L2; j++) {
+        int32_t sum = 0;
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++) sum += input[i] * network->hidden_weights[j][i];
+        sums[j] = sum;
+    }
+}
+
+#if DISPATCH_X86
+#define LANES_16 16 // int16 values in a 256-bit register
+#define LANES_8 32  // int8 values
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(int16_t* out, const int16_t* in, const int16_t* const* added, int added_count,
+                            const int16_t* const* removed, int removed_count) {
+    for (int i = 0; i < NNUE_HIDDEN; i += LANES_16) {
+        __m256i value = _mm256_loadu_si256((const __m256i*) (in + i));
+        for (int a = 0; a < added_count; a++) value = _mm256_add_epi16(value, _mm256_loadu_si256((const __m256i*) (added[a] + i)));
+        for (int r = 0; r < removed_count; r++) value = _mm256_sub_epi16(value, _mm256_loadu_si256((const __m256i*) (removed[r] + i)));
+        _mm256_storeu_si256((__m256i*) (out + i), value);
+    }
+}
+
+// 32 accumulator values (two registers) clipped to 0..NNUE_SCALE_A, as unsigned bytes in original order
+__attribute__((target("avx2")))
+static inline __m256i clip_avx2(const int16_t* values) {
+    __m256i low = _mm256_loadu_si256((const __m256i*) values);
+    __m256i high = _mm256_loadu_si256((const __m256i*) (values + LANES_16));
+    __m256i packed = _mm256_packus_epi16(low, high); // negatives are 0, but 128-bit lanes are interleaved
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);
+    return _mm256_min_epu8(packed, _mm256_set1_epi8(NNUE_SCALE_A));
+}
+
+__attribute__((target("avx2")))
+static void hidden_avx2(const Network* network, const int16_t* own, const int16_t* other, int32_t* sums) {
+    __m256i input[2 * NNUE_HIDDEN / LANES_8];
+    for (int k = 0; k < NNUE_HIDDEN / LANES_8; k++) {
+        input[k] = clip_avx2(own + k * LANES_8);
+        input[NNUE_HIDDEN / LANES_8 + k] = clip_avx2(other + k * LANES_8);
+    }
+    __m256i ones = _mm256_set1_epi16(1);
+    for (int j = 0; j < NNUE_L2; j++) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int k = 0; k < 2 * NNUE_HIDDEN / LANES_8; k++) {
+            __m256i weights = _mm256_loadu_si256((const __m256i*) (network->hidden_weights[j] + k * LANES_8));
+            // u8 * s8 pairs fit int16 (2 * 127 * 127), widened to int32 before they are added up
+            __m256i products = _mm256_maddubs_epi16(input[k], weights);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+        sums[j] = _mm_cvtsi128_si32(half);
+    }
+}
+#endif
+
+// fastest first (see dispatch.h)
+static const KernelInfo kernels[] = {
+#if DISPATCH_X86
+    {{"avx2",   cpu_has_avx2}, accumulate_avx2,   hidden_avx2},
+#endif
+    {{"scalar", cpu_any},      accumulate_scalar, hidden_scalar},
+};
+static KernelTable kernel_table = KERNEL_TABLE(kernels);
+
+Network* nnue_load(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    NnueFileHeader header;
+    Network* network = aligned_alloc(_Alignof(Network), sizeof(Network));
+    bool ok = network != NULL
+              && fread(&header, sizeof(header), 1, file) == 1
+              && memcmp(header.magic, NNUE_MAGIC, 4) == 0 && header.version == NNUE_VERSION
+              && header.features == NNUE_FEATURES && header.hidden == NNUE_HIDDEN && header.l2 == NNUE_L2
+              && fread(network, sizeof(Network), 1, file) == 1
+              && fgetc(file) == EOF;
+    fclose(file);
+    if (!ok) {
+        free(network);
+        return NULL;
+    }
+    return network;
+}
+
+void nnue_free(Network* network) {
+    free(network);
+}
+
+bool nnue_write(const char* path, const Network* network) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+    NnueFileHeader header = {{0}, NNUE_VERSION, NNUE_FEATURES, NNUE_HIDDEN, NNUE_L2};
+    memcpy(header.magic, NNUE_MAGIC, 4);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(network, sizeof(Network), 1, file) == 1;
+    return (fclose(file) == 0) && ok;
+}
+
+int nnue_feature(Player perspective, int kind, int square) {
+    // kinds are white man, white king, black man, black king: for black own pieces are the last two
+    if (perspective == computer) return (kind ^ 2) * SQUARE_COUNT + (SQUARE_COUNT - 1 - square);
+    return kind * SQUARE_COUNT + square;
+}
+
+static inline int piece_kind(const Board* board, int square) {
+    int kind = ((board->white >> square) & 1) ? zobrist_white_man : zobrist_black_man;
+    return ((board->kings >> square) & 1) ? kind + 1 : kind;
+}
+
+void nnue_refresh(const Network* network, const Board* board, NnueAccumulator* accumulator) {
+    const KernelInfo* kernel = kernel_current(&kernel_table);
+    for (Player perspective = human; perspective <= computer; perspective++) {
+        const int16_t* rows[SQUARE_COUNT];
+        int count = 0;
+        for (Bitboard pieces = board->white | board->black; pieces; pieces &= pieces - 1) {
+            int square = __builtin_ctz(pieces);
+            rows[count++] = network->feature_weights[nnue_feature(perspective, piece_kind(board, square), square)];
+        }
+        kernel->accumulate(accumulator->values[perspective], network->feature_bias, rows, count, NULL, 0);
+    }
+}
+
+void nnue_update(const Network* network, const NnueAccumulator* before, NnueAccumulator* after,
+                 const Board* board, const BoardMove* move) {
+    int kind = piece_kind(board, move->from);
+    int landed = move->promotes ? kind + 1 : kind; // man is crowned on the last row
+    const KernelInfo* kernel = kernel_current(&kernel_table);
+    for (Player perspective = human; perspective <= computer; perspective++) {
+        const int16_t* added[1] = {network->feature_weights[nnue_feature(perspective, landed, move->dest)]};
+        const int16_t* removed[MAX_CHANGES];
+        int removed_count = 0;
+        removed[removed_count++] = network->feature_weights[nnue_feature(perspective, kind, move->from)];
+        for (Bitboard taken = move->captured; taken; taken &= taken - 1) {
+            int square = __builtin_ctz(taken);
+            removed[removed_count++] = network->feature_weights[nnue_feature(perspective, piece_kind(board, square), square)];
+        }
+        kernel->accumulate(after->values[perspective], before->values[perspective], added, 1, removed, removed_count);
+    }
+}
+
+int nnue_evaluate(const Network* network, const NnueAccumulator* accumulator, Player to_move) {
+    int32_t sums[NNUE_L2];
+    const KernelInfo* kernel = kernel_current(&kernel_table);
+    kernel->hidden(network, accumulator->values[to_move], accumulator->values[1 - to_move], sums);
+    int64_t output = network->output_bias;
+    for (int j = 0; j < NNUE_L2; j++) {
+        int32_t value = (sums[j] + network->hidden_bias[j]) / NNUE_SCALE_B; // back to accumulator scale
+        output += (int64_t) (value < 0 ? 0 : value > NNUE_SCALE_A ? NNUE_SCALE_A : value) * network->output_weights[j];
+    }
+    int64_t eval = output * MAN_VALUE / (NNUE_SCALE_A * NNUE_SCALE_B);
+    return (int) (eval < -NNUE_MAX_EVAL ? -NNUE_MAX_EVAL : eval > NNUE_MAX_EVAL ? NNUE_MAX_EVAL : eval);
+}
+
+int nnue_evaluate_board(const Network* network, const Board* board) {
+    NnueAccumulator accumulator;
+    nnue_refresh(network, board, &accumulator);
+    return nnue_evaluate(network, &accumulator, board->current_player);
+}
+
+const char* nnue_kernel_name(void) {
+    return ((const KernelInfo*) kernel_current(&kernel_table))->header.name;
+}
+
+bool nnue_set_kernel(const char* name) {
+    return kernel_select(&kernel_table, name);
+}
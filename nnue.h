@@ -0,0 +1,95 @@
+#ifndef CHECKERS_V2_NNUE_H
+#define CHECKERS_V2_NNUE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "bitboard.h"
+
+/*
+ * Neural network evaluation (NNUE)
+ * --------------------------------
+ * inputs are (piece kind, square) pairs seen by each player: own man, own king, opponent's man,
+ * opponent's king on 32 squares, black sees the board turned around (square s is 31 - s), so the
+ * same weights serve both sides. first layer is a sum of weight rows of pieces on the board, the
+ * accumulator: a move changes only a few pieces, so search updates it (nnue_update) instead of
+ * summing it again. accumulator of player to move and of the opponent go through clipped ReLU to
+ * the small dense layers, which run on int8 with AVX2 (scalar on other CPUs).
+ *
+ * integer scales: accumulator 1.0 = NNUE_SCALE_A, hidden weights 1.0 = NNUE_SCALE_B (biases are
+ * stored already multiplied by both), output 1.0 = one man (MAN_VALUE in eval.h).
+ * file (native byte order) is NnueFileHeader followed by Network, it is made by nnuetrain
+ */
+
+#define NNUE_MAGIC "CKNN"
+#define NNUE_VERSION 1
+#define NNUE_FEATURES 128   // 4 piece kinds * 32 squares
+#define NNUE_HIDDEN 128     // accumulator of one side
+#define NNUE_L2 16
+#define NNUE_SCALE_A 127
+#define NNUE_SCALE_B 64
+#define NNUE_MAX_EVAL 3000  // network output is clamped, so it never looks like a won game
+
+typedef struct NnueFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t features;
+    uint32_t hidden;
+    uint32_t l2;
+} NnueFileHeader;
+
+typedef struct Network {
+    _Alignas(64) int16_t feature_weights[NNUE_FEATURES][NNUE_HIDDEN];
+    int16_t feature_bias[NNUE_HIDDEN];
+    int8_t hidden_weights[NNUE_L2][2 * NNUE_HIDDEN]; // player to move's half first
+    int32_t hidden_bias[NNUE_L2];
+    int16_t output_weights[NNUE_L2];
+    int32_t output_bias;
+} Network;
+
+typedef struct NnueAccumulator {
+    _Alignas(64) int16_t values[2][NNUE_HIDDEN]; // [Player] perspective
+} NnueAccumulator;
+
+/*
+ * Loads network file, NULL if it can't be read or doesn't fit this build's network size
+ */
+Network* nnue_load(const char* path);
+void nnue_free(Network* network);
+
+/*
+ * Writes network file, false on error
+ */
+bool nnue_write(const char* path, const Network* network);
+
+/*
+ * Index of input of piece (zobrist kind, see zobrist.h) standing on square, as seen by perspective
+ */
+int nnue_feature(Player perspective, int kind, int square);
+
+/*
+ * Computes accumulator of board from scratch
+ */
+void nnue_refresh(const Network* network, const Board* board, NnueAccumulator* accumulator);
+
+/*
+ * Accumulator of position after move from accumulator of board before it (move is not made here)
+ */
+void nnue_update(const Network* network, const NnueAccumulator* before, NnueAccumulator* after,
+                 const Board* board, const BoardMove* move);
+
+/*
+ * Value of position from the point of view of player to move (same units as find_val)
+ */
+int nnue_evaluate(const Network* network, const NnueAccumulator* accumulator, Player to_move);
+
+/*
+ * Refresh and evaluate in one go, for positions that are not reached by making moves
+ */
+int nnue_evaluate_board(const Network* network, const Board* board);
+
+/*
+ * Kernel the layers run on: "avx2" or "scalar", nnue_set_kernel picks another one (false if CPU can't run it)
+ */
+const char* nnue_kernel_name(void);
+bool nnue_set_kernel(const char* name);
+
+#endif //CHECKERS_V2_NNUE_H
@@ -0,0 +1,424 @@
+/*
+ * Evaluation network trainer
+ * --------------------------
+ * usage: nnuetrain gen <games> <search depth> <data file> [seed] [network]
+ *        nnuetrain train <data file> <epochs> <output file> [seed]
+ *
+ * gen: engine plays games against itself (first few plies are random, so games differ) and appends every
+ * quiet position (player to move has no jump, only such positions are evaluated) with its search score
+ * and result of the game to data file. search evaluates with network if one is given, so a network
+ * can be trained again on better data.
+ * train: fits float network to data, target is a mix of search score and game result (both as
+ * win probability), then writes it quantized (see nnue.h). 1/20 of positions are kept aside
+ * to tell whether the network learns or only remembers
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "ai.h"
+#include "nnue.h"
+#include "zobrist.h"
+#include "eval.h"
+
+#define MAX_GAME_PLIES 200
+#define MIN_RANDOM_PLIES 4
+#define MAX_RANDOM_PLIES 8
+#define DECIDED_SCORE (WIN_SCORE / 2) // game is over once search sees a win
+#define BATCH_SIZE 256
+#define LEARNING_RATE 0.001f
+#define LEARNING_RATE_DECAY 0.85f     // per epoch
+#define SCORE_WEIGHT 0.75f            // share of search score in target, the rest is game result
+#define SIGMOID_SCALE 200.0f          // score (in find_val units) of 73% win probability
+#define VALIDATION_SHARE 20           // every 20th position is for validation
+#define MAX_HIDDEN_WEIGHT (127.0f / NNUE_SCALE_B) // hidden weights must fit int8 when quantized
+
+typedef struct Sample {
+    Bitboard white;
+    Bitboard black;
+    Bitboard kings;
+    uint8_t to_move; // Player
+    int8_t result;   // 1 white (human) won, -1 black won, 0 draw
+    int16_t score;   // search score, from the point of view of player to move
+} Sample;
+
+// same layout as Network, in floats (1.0 is 1.0 on every layer)
+typedef struct FloatNetwork {
+    float feature_weights[NNUE_FEATURES][NNUE_HIDDEN];
+    float feature_bias[NNUE_HIDDEN];
+    float hidden_weights[NNUE_L2][2 * NNUE_HIDDEN];
+    float hidden_bias[NNUE_L2];
+    float output_weights[NNUE_L2];
+    float output_bias;
+} FloatNetwork;
+#define PARAMETER_COUNT (int) (sizeof(FloatNetwork) / sizeof(float))
+
+// values of one forward pass, kept for backward pass
+typedef struct Pass {
+    int features[2][SQUARE_COUNT]; // [0] player to move's view, [1] opponent's
+    int feature_count;
+    float accumulator[2][NNUE_HIDDEN];
+    float input[2 * NNUE_HIDDEN];
+    float hidden[NNUE_L2];
+    float activation[NNUE_L2];
+    float output;
+} Pass;
+
+typedef struct Trainer {
+    FloatNetwork network;
+    FloatNetwork gradient;
+    FloatNetwork moment;   // Adam: mean of gradients
+    FloatNetwork variance; // Adam: mean of squared gradients
+    int steps;
+} Trainer;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// splitmix64, so data and initial weights depend only on seed
+static uint64_t next_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static float random_uniform(uint64_t* state, float limit) {
+    return ((float) (next_random(state) >> 40) / (float) (1 << 24) * 2.0f - 1.0f) * limit;
+}
+
+static float sigmoid(float x) {
+    return 1.0f / (1.0f + expf(-x));
+}
+
+/* data */
+
+static int generate(int games, int depth, const char* path, uint64_t seed) {
+    FILE* file = fopen(path, "ab");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        return EXIT_FAILURE;
+    }
+    Sample* samples = malloc(MAX_GAME_PLIES * sizeof(Sample));
+    double start = now_seconds();
+    long total = 0;
+    for (int g = 0; g < games; g++) {
+        Game game;
+        init_game(&game);
+        Board board;
+        board_from_game(&board, &game);
+        int random_plies = MIN_RANDOM_PLIES + (int) (next_random(&seed) % (MAX_RANDOM_PLIES - MIN_RANDOM_PLIES + 1));
+        int count = 0;
+        int8_t result = 0; // draw if game takes too long or player can't move (as in game_loop)
+        for (int ply = 0; ply < MAX_GAME_PLIES; ply++) {
+            BoardMoveList moves;
+            board_moves(&board, &moves);
+            if (moves.count == 0) {
+                if (board_pieces_count(&board, board.current_player) == 0) result = (board.current_player == human) ? -1 : 1;
+                break;
+            }
+            if (ply < random_plies) {
+                apply_move(&board, &moves.moves[next_random(&seed) % moves.count]);
+                continue;
+            }
+            SearchResult found = search(&board, depth);
+            if (found.score >= DECIDED_SCORE || found.score <= -DECIDED_SCORE) {
+                bool white_wins = (found.score > 0) == (board.current_player == human);
+                result = white_wins ? 1 : -1;
+                break;
+            }
+            if (!board_has_captures(&board)) {
+                samples[count++] = (Sample) {board.white, board.black, board.kings, (uint8_t) board.current_player,
+                                             0, (int16_t) found.score};
+            }
+            apply_move(&board, &found.move);
+        }
+        for (int i = 0; i < count; i++) samples[i].result = result;
+        if (fwrite(samples, sizeof(Sample), count, file) != (size_t) count) {
+            fprintf(stderr, "can't write %s\n", path);
+            fclose(file);
+            free(samples);
+            return EXIT_FAILURE;
+        }
+        total += count;
+        if ((g + 1) % 100 == 0) {
+            printf("%d games, %ld positions (%.0fs)\n", g + 1, total, now_seconds() - start);
+            fflush(stdout);
+        }
+    }
+    free(samples);
+    bool ok = fclose(file) == 0;
+    printf("%s: %ld positions added from %d games at depth %d (%.0fs)\n", path, total, games, depth, now_seconds() - start);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Sample* read_samples(const char* path, long* count) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    *count = ftell(file) / (long) sizeof(Sample);
+    fseek(file, 0, SEEK_SET);
+    Sample* samples = malloc((*count > 0 ? *count : 1) * sizeof(Sample));
+    if (samples != NULL && fread(samples, sizeof(Sample), *count, file) != (size_t) *count) {
+        free(samples);
+        samples = NULL;
+    }
+    fclose(file);
+    return samples;
+}
+
+static void sample_board(const Sample* sample, Board* board) {
+    board->white = sample->white;
+    board->black = sample->black;
+    board->kings = sample->kings;
+    board->current_player = (Player) sample->to_move;
+    board->key = board_key(board);
+    board->value = board_value(board);
+}
+
+// what network should say, as win probability of player to move
+static float sample_target(const Sample* sample) {
+    float result = (sample->result == 0) ? 0.5f : ((sample->result > 0) == (sample->to_move == human)) ? 1.0f : 0.0f;
+    return SCORE_WEIGHT * sigmoid(sample->score / SIGMOID_SCALE) + (1.0f - SCORE_WEIGHT) * result;
+}
+
+/* float network */
+
+static void forward(const FloatNetwork* network, const Sample* sample, Pass* pass) {
+    Board board;
+    sample_board(sample, &board);
+    Player views[2] = {board.current_player, (board.current_player == human) ? computer : human};
+    pass->feature_count = 0;
+    for (Bitboard pieces = board.white | board.black; pieces; pieces &= pieces - 1) {
+        int square = __builtin_ctz(pieces);
+        int kind = ((board.white >> square) & 1) ? zobrist_white_man : zobrist_black_man;
+        if ((board.kings >> square) & 1) kind++;
+        for (int v = 0; v < 2; v++) pass->features[v][pass->feature_count] = nnue_feature(views[v], kind, square);
+        pass->feature_count++;
+    }
+    for (int v = 0; v < 2; v++) {
+        float* accumulator = pass->accumulator[v];
+        memcpy(accumulator, network->feature_bias, sizeof(network->feature_bias));
+        for (int f = 0; f < pass->feature_count; f++) {
+            const float* row = network->feature_weights[pass->features[v][f]];
+            for (int i = 0; i < NNUE_HIDDEN; i++) accumulator[i] += row[i];
+        }
+        for (int i = 0; i < NNUE_HIDDEN; i++) pass->input[v * NNUE_HIDDEN + i] = fminf(fmaxf(accumulator[i], 0.0f), 1.0f);
+    }
+    pass->output = network->output_bias;
+    for (int j = 0; j < NNUE_L2; j++) {
+        float sum = network->hidden_bias[j];
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++) sum += network->hidden_weights[j][i] * pass->input[i];
+        pass->hidden[j] = sum;
+        pass->activation[j] = fminf(fmaxf(sum, 0.0f), 1.0f);
+        pass->output += network->output_weights[j] * pass->activation[j];
+    }
+}
+
+// output is in men, score in find_val units
+static float output_score(const Pass* pass) {
+    return pass->output * MAN_VALUE;
+}
+
+// adds gradient of squared error of win probability to trainer's gradient, returns the error
+static float backward(Trainer* trainer, const Pass* pass, float target) {
+    const FloatNetwork* network = &trainer->network;
+    FloatNetwork* gradient = &trainer->gradient;
+    float probability = sigmoid(output_score(pass) / SIGMOID_SCALE);
+    float error = probability - target;
+    float output_gradient = 2.0f * error * probability * (1.0f - probability) * MAN_VALUE / SIGMOID_SCALE;
+
+    float input_gradient[2 * NNUE_HIDDEN] = {0};
+    gradient->output_bias += output_gradient;
+    for (int j = 0; j < NNUE_L2; j++) {
+        gradient->output_weights[j] += output_gradient * pass->activation[j];
+        if (pass->hidden[j] <= 0.0f || pass->hidden[j] >= 1.0f) continue; // clipped, no gradient
+        float hidden_gradient = output_gradient * network->output_weights[j];
+        gradient->hidden_bias[j] += hidden_gradient;
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++) {
+            gradient->hidden_weights[j][i] += hidden_gradient * pass->input[i];
+            input_gradient[i] += hidden_gradient * network->hidden_weights[j][i];
+        }
+    }
+    for (int v = 0; v < 2; v++) {
+        for (int i = 0; i < NNUE_HIDDEN; i++) {
+            float accumulator = pass->accumulator[v][i];
+            if (accumulator <= 0.0f || accumulator >= 1.0f) input_gradient[v * NNUE_HIDDEN + i] = 0.0f;
+            gradient->feature_bias[i] += input_gradient[v * NNUE_HIDDEN + i];
+        }
+        for (int f = 0; f < pass->feature_count; f++) {
+            float* row = gradient->feature_weights[pass->features[v][f]];
+            for (int i = 0; i < NNUE_HIDDEN; i++) row[i] += input_gradient[v * NNUE_HIDDEN + i];
+        }
+    }
+    return error * error;
+}
+
+// Adam step with gradient summed over count samples, gradient is cleared
+static void update(Trainer* trainer, int count, float learning_rate) {
+    const float beta1 = 0.9f, beta2 = 0.999f, epsilon = 1e-8f;
+    trainer->steps++;
+    float correction1 = 1.0f - powf(beta1, (float) trainer->steps);
+    float correction2 = 1.0f - powf(beta2, (float) trainer->steps);
+    float* parameters = (float*) &trainer->network;
+    float* gradients = (float*) &trainer->gradient;
+    float* moments = (float*) &trainer->moment;
+    float* variances = (float*) &trainer->variance;
+    for (int p = 0; p < PARAMETER_COUNT; p++) {
+        float g = gradients[p] / (float) count;
+        moments[p] = beta1 * moments[p] + (1.0f - beta1) * g;
+        variances[p] = beta2 * variances[p] + (1.0f - beta2) * g * g;
+        parameters[p] -= learning_rate * (moments[p] / correction1) / (sqrtf(variances[p] / correction2) + epsilon);
+    }
+    memset(gradients, 0, sizeof(FloatNetwork));
+    for (int j = 0; j < NNUE_L2; j++) {
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++) {
+            float* weight = &trainer->network.hidden_weights[j][i];
+            *weight = fminf(fmaxf(*weight, -MAX_HIDDEN_WEIGHT), MAX_HIDDEN_WEIGHT);
+        }
+    }
+}
+
+static void initialize(FloatNetwork* network, uint64_t* seed) {
+    memset(network, 0, sizeof(*network));
+    for (int f = 0; f < NNUE_FEATURES; f++) {
+        for (int i = 0; i < NNUE_HIDDEN; i++) network->feature_weights[f][i] = random_uniform(seed, 0.1f);
+    }
+    for (int i = 0; i < NNUE_HIDDEN; i++) network->feature_bias[i] = 0.5f;
+    for (int j = 0; j < NNUE_L2; j++) {
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++) network->hidden_weights[j][i] = random_uniform(seed, 0.1f);
+        network->output_weights[j] = random_uniform(seed, 0.5f);
+    }
+}
+
+static int16_t quantize16(float value, float scale) {
+    float scaled = roundf(value * scale);
+    return (int16_t) fminf(fmaxf(scaled, -32767.0f), 32767.0f);
+}
+
+static void quantize(const FloatNetwork* source, Network* network) {
+    memset(network, 0, sizeof(*network));
+    for (int f = 0; f < NNUE_FEATURES; f++) {
+        for (int i = 0; i < NNUE_HIDDEN; i++) network->feature_weights[f][i] = quantize16(source->feature_weights[f][i], NNUE_SCALE_A);
+    }
+    for (int i = 0; i < NNUE_HIDDEN; i++) network->feature_bias[i] = quantize16(source->feature_bias[i], NNUE_SCALE_A);
+    for (int j = 0; j < NNUE_L2; j++) {
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++) {
+            network->hidden_weights[j][i] = (int8_t) fminf(fmaxf(roundf(source->hidden_weights[j][i] * NNUE_SCALE_B), -127.0f), 127.0f);
+        }
+        network->hidden_bias[j] = (int32_t) roundf(source->hidden_bias[j] * NNUE_SCALE_A * NNUE_SCALE_B);
+        network->output_weights[j] = quantize16(source->output_weights[j], NNUE_SCALE_B);
+    }
+    network->output_bias = (int32_t) roundf(source->output_bias * NNUE_SCALE_A * NNUE_SCALE_B);
+}
+
+static float validation_loss(const FloatNetwork* network, const Sample* samples, long count) {
+    double loss = 0;
+    long used = 0;
+    for (long i = 0; i < count; i += VALIDATION_SHARE) {
+        Pass pass;
+        forward(network, &samples[i], &pass);
+        float error = sigmoid(output_score(&pass) / SIGMOID_SCALE) - sample_target(&samples[i]);
+        loss += error * error;
+        used++;
+    }
+    return (used > 0) ? (float) (loss / used) : 0.0f;
+}
+
+static int train(const char* data_path, int epochs, const char* output_path, uint64_t seed) {
+    long count = 0;
+    Sample* samples = read_samples(data_path, &count);
+    if (samples == NULL || count == 0) {
+        fprintf(stderr, "can't read positions from %s\n", data_path);
+        free(samples);
+        return EXIT_FAILURE;
+    }
+    // positions of one game follow each other, shuffled so batches mix games
+    for (long i = count - 1; i > 0; i--) {
+        long j = (long) (next_random(&seed) % (uint64_t) (i + 1));
+        Sample swap = samples[i];
+        samples[i] = samples[j];
+        samples[j] = swap;
+    }
+    Trainer* trainer = calloc(1, sizeof(Trainer));
+    initialize(&trainer->network, &seed);
+    printf("%ld positions (%ld for validation)\n", count, (count + VALIDATION_SHARE - 1) / VALIDATION_SHARE);
+
+    double start = now_seconds();
+    float learning_rate = LEARNING_RATE;
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        double loss = 0;
+        long used = 0;
+        int in_batch = 0;
+        for (long i = 0; i < count; i++) {
+            if (i % VALIDATION_SHARE == 0) continue;
+            Pass pass;
+            forward(&trainer->network, &samples[i], &pass);
+            loss += backward(trainer, &pass, sample_target(&samples[i]));
+            used++;
+            if (++in_batch == BATCH_SIZE) {
+                update(trainer, in_batch, learning_rate);
+                in_batch = 0;
+            }
+        }
+        if (in_batch > 0) update(trainer, in_batch, learning_rate);
+        learning_rate *= LEARNING_RATE_DECAY;
+        printf("epoch %d: loss %.6f, validation loss %.6f (%.0fs)\n", epoch, loss / (double) used,
+               validation_loss(&trainer->network, samples, count), now_seconds() - start);
+        fflush(stdout);
+    }
+
+    Network* network = aligned_alloc(_Alignof(Network), sizeof(Network));
+    quantize(&trainer->network, network);
+    // quantized network has to agree with float one, up to rounding
+    double difference = 0;
+    long compared = 0;
+    for (long i = 0; i < count; i += VALIDATION_SHARE) {
+        Pass pass;
+        forward(&trainer->network, &samples[i], &pass);
+        Board board;
+        sample_board(&samples[i], &board);
+        float expected = fminf(fmaxf(output_score(&pass), -NNUE_MAX_EVAL), NNUE_MAX_EVAL);
+        difference += fabsf((float) nnue_evaluate_board(network, &board) - expected);
+        compared++;
+    }
+    printf("quantized network is off by %.2f on average\n", compared > 0 ? difference / (double) compared : 0.0);
+    bool ok = nnue_write(output_path, network);
+    if (!ok) fprintf(stderr, "can't write %s\n", output_path);
+    free(network);
+    free(trainer);
+    free(samples);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 5 && strcmp(argv[1], "gen") == 0) {
+        int games = atoi(argv[2]);
+        int depth = atoi(argv[3]);
+        uint64_t seed = (argc > 5) ? strtoull(argv[5], NULL, 10) : 1;
+        if (games < 1 || depth < 1 || depth >= MAX_PLY) {
+            fprintf(stderr, "games and depth must be positive, depth less than %d\n", MAX_PLY);
+            return EXIT_FAILURE;
+        }
+        if (argc > 6 && !ai_load_nnue(argv[6])) {
+            fprintf(stderr, "can't load network %s\n", argv[6]);
+            return EXIT_FAILURE;
+        }
+        return generate(games, depth, argv[4], seed);
+    }
+    if (argc >= 5 && strcmp(argv[1], "train") == 0) {
+        int epochs = atoi(argv[3]);
+        if (epochs < 1) {
+            fprintf(stderr, "epochs must be positive\n");
+            return EXIT_FAILURE;
+        }
+        return train(argv[2], epochs, argv[4], (argc > 5) ? strtoull(argv[5], NULL, 10) : 1);
+    }
+    fprintf(stderr, "usage: %s gen <games> <search depth> <data file> [seed] [network]\n"
+                    "       %s train <data file> <epochs> <output file> [seed]\n", argv[0], argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,210 @@
+/*
+ * Perft: move generator test
+ * --------------------------
+ * usage: perft <depth> [-d] [-h hash MB] [-t threads] [-p position]
+ *
+ * counts positions reached after exactly depth plies (every legal move sequence counts once,
+ * multi-jump is one move) from starting position or given one, and prints how fast that was.
+ *  -d  divide: count of every root move separately (to find which move generator gets wrong)
+ *  -h  remember counts of subtrees in hash table of given size, so subtree reached again by another
+ *      move order is not walked again
+ *  -t  split work over threads (moves of first two plies are tasks)
+ *  -p  position in text form of bitboard.h, e.g. b:bbbbbbbbbbbb........wwwwwwwwwwww (starting position)
+ * counts from starting position are checked against known numbers
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "bitboard.h"
+#include "threadpool.h"
+
+#define MAX_DEPTH 64
+
+// known perft numbers of starting position, [depth]
+static const uint64_t start_counts[] = {
+    1, 7, 49, 302, 1469, 7361, 36768, 179740, 845931, 3963680, 18391564, 85242128,
+    388623673, 1766623630, 7978439499
+};
+#define KNOWN_DEPTH (int) (sizeof(start_counts) / sizeof(start_counts[0]) - 1)
+
+// hash entry, check is key ^ count so torn writes of other threads are noticed (as in tt.c)
+typedef struct PerftEntry {
+    _Atomic uint64_t check;
+    _Atomic uint64_t count;
+} PerftEntry;
+
+typedef struct PerftHash {
+    PerftEntry* entries;
+    uint64_t mask;
+} PerftHash;
+
+// subtree under one move of first two plies
+typedef struct PerftTask {
+    Board board;             // position after the move(s)
+    int depth;               // plies left
+    const PerftHash* hash;
+    _Atomic uint64_t* total; // count of root move the task belongs to
+} PerftTask;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// key of position at given depth (same position at different depth has different count)
+static uint64_t hash_key(const Board* board, int depth) {
+    return board->key ^ ((uint64_t) depth * 0x9E3779B97F4A7C15ull);
+}
+
+static bool hash_probe(const PerftHash* hash, uint64_t key, uint64_t* count) {
+    const PerftEntry* entry = &hash->entries[key & hash->mask];
+    uint64_t stored = atomic_load_explicit(&entry->count, memory_order_relaxed);
+    if ((atomic_load_explicit(&entry->check, memory_order_relaxed) ^ stored) != key) return false;
+    *count = stored;
+    return true;
+}
+
+static void hash_store(const PerftHash* hash, uint64_t key, uint64_t count) {
+    PerftEntry* entry = &hash->entries[key & hash->mask];
+    atomic_store_explicit(&entry->check, key ^ count, memory_order_relaxed);
+    atomic_store_explicit(&entry->count, count, memory_order_relaxed);
+}
+
+static uint64_t perft(Board* board, int depth, const PerftHash* hash) {
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    if (depth == 1) return (uint64_t) moves.count; // leaves are only counted
+    uint64_t key = 0;
+    uint64_t count = 0;
+    if (hash != NULL) {
+        key = hash_key(board, depth);
+        if (hash_probe(hash, key, &count)) return count;
+    }
+    for (int i = 0; i < moves.count; i++) {
+        Undo undo;
+        make_move(board, &moves.moves[i], &undo);
+        count += perft(board, depth - 1, hash);
+        unmake_move(board, &moves.moves[i], &undo);
+    }
+    if (hash != NULL) hash_store(hash, key, count);
+    return count;
+}
+
+static void perft_task(void* arg) {
+    PerftTask* task = arg;
+    uint64_t count = (task->depth == 0) ? 1 : perft(&task->board, task->depth, task->hash);
+    atomic_fetch_add(task->total, count);
+}
+
+int main(int argc, char* argv[]) {
+    int depth = 0;
+    bool divide = false;
+    size_t hash_mb = 0;
+    int threads = 1;
+    const char* position = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0) divide = true;
+        else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) hash_mb = (size_t) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) position = argv[++i];
+        else depth = atoi(argv[i]);
+    }
+    if (depth < 1 || depth > MAX_DEPTH) {
+        fprintf(stderr, "usage: %s <depth> [-d] [-h hash MB] [-t threads] [-p position]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Board board;
+    if (position == NULL) {
+        Game game;
+        init_game(&game);
+        board_from_game(&board, &game);
+    } else if (!board_from_string(&board, position)) {
+        fprintf(stderr, "bad position: %s\n", position);
+        return EXIT_FAILURE;
+    }
+
+    PerftHash hash = {NULL, 0};
+    if (hash_mb > 0) {
+        uint64_t count = 1;
+        while (2 * count * sizeof(PerftEntry) <= hash_mb * 1024 * 1024) count *= 2;
+        hash.entries = calloc(count, sizeof(PerftEntry));
+        hash.mask = count - 1;
+        if (hash.entries == NULL) {
+            fprintf(stderr, "can't allocate hash table\n");
+            return EXIT_FAILURE;
+        }
+    }
+    ThreadPool* pool = (threads > 1) ? threadpool_create(threads) : NULL;
+
+    double start = now_seconds();
+    BoardMoveList moves;
+    board_moves(&board, &moves);
+    _Atomic uint64_t* counts = calloc(moves.count > 0 ? moves.count : 1, sizeof(_Atomic uint64_t));
+    if (pool != NULL) {
+        // tasks for every move of the first two plies, so there are enough of them to keep threads busy
+        PerftTask* tasks = malloc(moves.count * MAX_BOARD_MOVES * sizeof(PerftTask));
+        int task_count = 0;
+        TaskGroup group;
+        task_group_init(&group);
+        for (int i = 0; i < moves.count; i++) {
+            Board after = board;
+            apply_move(&after, &moves.moves[i]);
+            BoardMoveList replies;
+            board_moves(&after, &replies);
+            if (depth == 1 || replies.count == 0) {
+                atomic_store(&counts[i], depth == 1 ? 1 : 0);
+                continue;
+            }
+            for (int j = 0; j < replies.count; j++) {
+                PerftTask* task = &tasks[task_count++];
+                task->board = after;
+                apply_move(&task->board, &replies.moves[j]);
+                task->depth = depth - 2;
+                task->hash = (hash.entries != NULL) ? &hash : NULL;
+                task->total = &counts[i];
+                threadpool_submit(pool, &group, perft_task, task);
+            }
+        }
+        threadpool_wait(pool, &group);
+        free(tasks);
+    } else {
+        for (int i = 0; i < moves.count; i++) {
+            Board after = board;
+            apply_move(&after, &moves.moves[i]);
+            atomic_store(&counts[i], (depth == 1) ? 1 : perft(&after, depth - 1, (hash.entries != NULL) ? &hash : NULL));
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    uint64_t total = 0;
+    for (int i = 0; i < moves.count; i++) {
+        uint64_t count = atomic_load(&counts[i]);
+        total += count;
+        if (divide) {
+            char move[BOARD_MOVE_STRING_SIZE];
+            board_move_to_string(&moves.moves[i], move);
+            printf("%-8s %llu\n", move, (unsigned long long) count);
+        }
+    }
+    printf("perft %d: %llu positions in %.3fs (%.0f positions/s)\n", depth, (unsigned long long) total,
+           elapsed, (elapsed > 0) ? (double) total / elapsed : 0.0);
+
+    bool ok = true;
+    Game game;
+    init_game(&game);
+    Board start_board;
+    board_from_game(&start_board, &game);
+    if (board.key == start_board.key && depth <= KNOWN_DEPTH) {
+        ok = (total == start_counts[depth]);
+        if (ok) printf("matches known count\n");
+        else printf("MISMATCH, known count is %llu\n", (unsigned long long) start_counts[depth]);
+    }
+    threadpool_destroy(pool);
+    free(counts);
+    free(hash.entries);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
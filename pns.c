@@ -0,0 +1,315 @@
+#include "pns.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STOP_CHECK_INTERVAL 4096 // positions between looks at the clock
+#define NO_LOOP (MAX_PLY + 1)    // loop ply of numbers that don't depend on positions before
+#define MAX_WORK UINT32_MAX
+
+// proof number is of player to move reaching the goal of its side, disproof of it failing,
+// so a position's proof is the smallest disproof of its children. disproof is the weak proof number: the
+// largest proof of children plus one for every other unsettled child. sum of their proofs would count
+// positions reached along several lines (and around cycles, with kings) many times and run up to infinity
+typedef struct Numbers {
+    uint32_t proof;
+    uint32_t disproof;
+} Numbers;
+
+// what a position knows about one of its children
+typedef struct Child {
+    Numbers numbers;
+    int loop_ply;      // numbers hold only if the position at this ply is before the child (see PnsEntry loop)
+    uint16_t distance;
+} Child;
+
+typedef struct Solver {
+    PnsTable* table;
+    Tablebase* tablebase; // NULL if there is none
+    Player attacker;      // player whose win is being proven
+    uint64_t nodes;
+    uint64_t max_nodes;   // 0 if there is no node limit
+    uint64_t deadline;    // monotonic time in ns, 0 if there is no time limit
+    atomic_bool* cancel;
+    bool stopped;
+    uint64_t path[MAX_PLY + 1]; // [ply] keys of positions from root to the one being searched
+} Solver;
+
+static const Numbers settled_failure = {PNS_INFINITY, 0}; // player to move doesn't reach its goal
+static const Numbers settled_success = {0, PNS_INFINITY};
+
+bool pns_init(PnsTable* table, size_t megabytes) {
+    uint64_t buckets = 1;
+    while (buckets * 2 * PNS_BUCKET_SIZE * sizeof(PnsEntry) <= (uint64_t) megabytes * 1024 * 1024) buckets *= 2;
+    table->entries = calloc(buckets * PNS_BUCKET_SIZE, sizeof(PnsEntry));
+    table->mask = buckets - 1;
+    return table->entries != NULL;
+}
+
+void pns_free(PnsTable* table) {
+    free(table->entries);
+    table->entries = NULL;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// sum stays below PNS_INFINITY unless one of them is settled, large numbers mustn't look settled
+static uint32_t add_numbers(uint32_t lhs, uint32_t rhs) {
+    if (lhs == PNS_INFINITY || rhs == PNS_INFINITY) return PNS_INFINITY;
+    return (lhs + rhs >= PNS_INFINITY) ? PNS_INFINITY - 1 : lhs + rhs;
+}
+
+static bool settled(Numbers numbers) {
+    return numbers.proof == 0 || numbers.disproof == 0;
+}
+
+// hash of the count positions before ply on solver's path
+static uint64_t path_hash(const Solver* solver, int ply, int count) {
+    uint64_t hash = 0;
+    for (int p = ply - count; p < ply; p++) hash = (hash ^ solver->path[p]) * 0x9E3779B97F4A7C15ull;
+    return hash;
+}
+
+static PnsEntry* find_entry(const PnsTable* table, uint64_t key) {
+    PnsEntry* bucket = &table->entries[(key & table->mask) * PNS_BUCKET_SIZE];
+    for (int i = 0; i < PNS_BUCKET_SIZE; i++) {
+        if (bucket[i].key == key) return &bucket[i];
+    }
+    return NULL;
+}
+
+static void store(const Solver* solver, uint64_t key, int ply, int loop_ply, Numbers numbers, uint64_t work, int distance) {
+    PnsTable* table = solver->table;
+    int loop = (loop_ply < ply) ? ply - loop_ply : 0;
+    PnsEntry* bucket = &table->entries[(key & table->mask) * PNS_BUCKET_SIZE];
+    PnsEntry* replace = &bucket[0];
+    for (int i = 0; i < PNS_BUCKET_SIZE; i++) {
+        if (bucket[i].key == key || bucket[i].key == 0) {
+            replace = &bucket[i];
+            break;
+        }
+        if (bucket[i].work < replace->work) replace = &bucket[i];
+    }
+    *replace = (PnsEntry) {key, path_hash(solver, ply, loop), numbers.proof, numbers.disproof,
+                           (uint32_t) (work < MAX_WORK ? work : MAX_WORK), (uint16_t) distance, (uint16_t) loop};
+}
+
+// draw: attacker fails, defender reaches its goal
+static Numbers draw_numbers(const Solver* solver, const Board* board) {
+    return (board->current_player == solver->attacker) ? settled_failure : settled_success;
+}
+
+// position where player to move has no moves, a loss if it has no pieces either
+static Numbers terminal_numbers(const Solver* solver, const Board* board) {
+    if (board_pieces_count(board, board->current_player) == 0) return settled_failure;
+    return draw_numbers(solver, board);
+}
+
+// ply of position with key on solver's path up to ply, -1 if there is none
+static int find_on_path(const Solver* solver, uint64_t key, int ply) {
+    for (int p = ply; p >= 0; p--) {
+        if (solver->path[p] == key) return p;
+    }
+    return -1;
+}
+
+// child reached from position at ply (unknown positions are 1, 1)
+static Child child_info(const Solver* solver, const Board* child, int ply) {
+    int repeated = find_on_path(solver, child->key, ply);
+    if (repeated >= 0) return (Child) {draw_numbers(solver, child), repeated, 0};
+    TBValue value;
+    if (solver->tablebase != NULL && tb_probe(solver->tablebase, child, &value)) {
+        if (value.outcome == TB_RESULT_DRAW) return (Child) {draw_numbers(solver, child), NO_LOOP, 0};
+        Numbers numbers = (value.outcome == TB_RESULT_WIN) ? settled_success : settled_failure;
+        return (Child) {numbers, NO_LOOP, (uint16_t) value.distance};
+    }
+    const PnsEntry* entry = find_entry(solver->table, child->key);
+    if (entry == NULL) return (Child) {{1, 1}, NO_LOOP, 0};
+    if (entry->loop == 0) return (Child) {{entry->proof, entry->disproof}, NO_LOOP, entry->distance};
+    if (entry->loop > ply + 1 || entry->path != path_hash(solver, ply + 1, entry->loop)) {
+        return (Child) {{1, 1}, NO_LOOP, 0}; // positions it depends on aren't before it now
+    }
+    return (Child) {{entry->proof, entry->disproof}, ply + 1 - entry->loop, entry->distance};
+}
+
+static bool should_stop(Solver* solver) {
+    if (solver->stopped) return true;
+    if (solver->max_nodes != 0 && solver->nodes >= solver->max_nodes) solver->stopped = true;
+    if (solver->nodes % STOP_CHECK_INTERVAL == 0) {
+        if ((solver->cancel != NULL && atomic_load_explicit(solver->cancel, memory_order_relaxed))
+            || (solver->deadline != 0 && now_ns() >= solver->deadline)) {
+            solver->stopped = true;
+        }
+    }
+    return solver->stopped;
+}
+
+/*
+ * Searches board until its proof number reaches proof_threshold or disproof number reaches disproof_threshold
+ * (or it is settled), stores and returns what it found. solver's path must be filled up to ply
+ */
+static Child expand_proof(Solver* solver, Board* board, int ply, uint32_t proof_threshold, uint32_t disproof_threshold) {
+    solver->nodes++;
+    uint64_t work_start = solver->nodes;
+    BoardMoveList moves;
+    board_moves(board, &moves);
+    if (moves.count == 0) {
+        Child result = {terminal_numbers(solver, board), NO_LOOP, 0};
+        store(solver, board->key, ply, NO_LOOP, result.numbers, 1, 0);
+        return result;
+    }
+    if (ply >= MAX_PLY - 1) {
+        Child result = {draw_numbers(solver, board), 0, 0}; // depends on the whole line
+        store(solver, board->key, ply, 0, result.numbers, 1, 0);
+        return result;
+    }
+    solver->path[ply] = board->key;
+    // children are read from the table once and then kept here: in a cycle the same position can be stored
+    // deeper with other numbers, reading it again would undo the progress and search it over and over
+    Child children[MAX_BOARD_MOVES];
+    for (int i = 0; i < moves.count; i++) {
+        Undo undo;
+        make_move(board, &moves.moves[i], &undo);
+        children[i] = child_info(solver, board, ply);
+        unmake_move(board, &moves.moves[i], &undo);
+    }
+
+    Child result;
+    for (;;) {
+        // smallest child disproof gives proof, second smallest limits how far the best child is searched
+        result.numbers = (Numbers) {PNS_INFINITY, 0};
+        uint32_t largest_proof = 0, unsettled = 0;
+        uint32_t second_disproof = PNS_INFINITY;
+        int best = 0;
+        // success needs one failing child (it depends on the line as little as the least dependent of those),
+        // failure needs all children to succeed (it depends on the line as much as the most dependent one)
+        int success_loop_ply = -1, failure_loop_ply = NO_LOOP;
+        int success_distance = MAX_PLY, failure_distance = 0;
+        for (int i = 0; i < moves.count; i++) {
+            const Child* child = &children[i];
+            if (child->numbers.proof > largest_proof) largest_proof = child->numbers.proof;
+            if (child->numbers.proof != 0) unsettled++;
+            if (child->numbers.disproof < result.numbers.proof) {
+                second_disproof = result.numbers.proof;
+                result.numbers.proof = child->numbers.disproof;
+                best = i;
+            } else if (child->numbers.disproof < second_disproof) {
+                second_disproof = child->numbers.disproof;
+            }
+            if (child->numbers.disproof == 0) {
+                if (child->loop_ply > success_loop_ply) success_loop_ply = child->loop_ply;
+                if (child->distance + 1 < success_distance) success_distance = child->distance + 1;
+            }
+            if (child->loop_ply < failure_loop_ply) failure_loop_ply = child->loop_ply;
+            if (child->distance + 1 > failure_distance) failure_distance = child->distance + 1;
+        }
+        if (unsettled > 0) result.numbers.disproof = add_numbers(largest_proof, unsettled - 1);
+        bool success = result.numbers.proof == 0;
+        result.loop_ply = success ? success_loop_ply : failure_loop_ply;
+        result.distance = (uint16_t) (success ? success_distance : failure_distance);
+        if (result.numbers.proof >= proof_threshold || result.numbers.disproof >= disproof_threshold
+            || should_stop(solver)) {
+            break;
+        }
+
+        // child is searched until it stops being the best one (1 + 1/4 of second best, so it doesn't flip back and forth)
+        // or its proof takes disproof of this position to the threshold
+        uint32_t child_proof_threshold =
+            (disproof_threshold == PNS_INFINITY) ? PNS_INFINITY : disproof_threshold - (unsettled - 1);
+        uint32_t child_disproof_threshold = add_numbers(second_disproof, second_disproof / 4 + 1);
+        if (child_disproof_threshold > proof_threshold) child_disproof_threshold = proof_threshold;
+        Undo undo;
+        make_move(board, &moves.moves[best], &undo);
+        children[best] = expand_proof(solver, board, ply + 1, child_proof_threshold, child_disproof_threshold);
+        unmake_move(board, &moves.moves[best], &undo);
+    }
+    if (!settled(result.numbers)) {
+        result.loop_ply = NO_LOOP;
+        result.distance = 0;
+    }
+    store(solver, board->key, ply, result.loop_ply, result.numbers, solver->nodes - work_start + 1, result.distance);
+    return result;
+}
+
+static bool attacker_wins(const Solver* solver, const Board* board, Numbers numbers) {
+    return (board->current_player == solver->attacker) ? numbers.proof == 0 : numbers.disproof == 0;
+}
+
+// line of proven win: attacker takes the child nearest to the win, defender the farthest one,
+// so distance goes down by one every ply. children the table has lost are proven again,
+// line is cut short if limits are reached meanwhile
+static int winning_line(Solver* solver, Board board, BoardMove* line) {
+    int length = 0;
+    while (length < MAX_PLY - 1 && !solver->stopped) {
+        BoardMoveList moves;
+        board_moves(&board, &moves);
+        if (moves.count == 0) break;
+        solver->path[length] = board.key;
+        bool attacker_moves = board.current_player == solver->attacker;
+        int chosen = -1, chosen_distance = 0;
+        // attacker's other moves may be unsettled (and expensive to settle), they are proven again only if no move is won
+        for (int pass = 0; pass < 2 && chosen < 0; pass++) {
+            for (int i = 0; i < moves.count && !(attacker_moves && pass == 1 && chosen >= 0); i++) {
+                Undo undo;
+                make_move(&board, &moves.moves[i], &undo);
+                Child child = child_info(solver, &board, length);
+                if (!settled(child.numbers) && (pass == 1 || !attacker_moves)) {
+                    child = expand_proof(solver, &board, length + 1, PNS_INFINITY, PNS_INFINITY);
+                }
+                bool won = attacker_wins(solver, &board, child.numbers);
+                unmake_move(&board, &moves.moves[i], &undo);
+                if (!won) continue;
+                if (chosen < 0 || (attacker_moves ? child.distance < chosen_distance : child.distance > chosen_distance)) {
+                    chosen = i;
+                    chosen_distance = child.distance;
+                }
+            }
+        }
+        if (chosen < 0) break; // only if search was stopped
+        line[length++] = moves.moves[chosen];
+        apply_move(&board, &moves.moves[chosen]);
+    }
+    return length;
+}
+
+// true if attacker's win is settled (proven or disproven) within limits, won is set to which of them
+static bool prove(Solver* solver, const Board* root, Player attacker, bool* won) {
+    memset(solver->table->entries, 0, (solver->table->mask + 1) * PNS_BUCKET_SIZE * sizeof(PnsEntry));
+    solver->attacker = attacker;
+    Board board = *root;
+    Numbers numbers = expand_proof(solver, &board, 0, PNS_INFINITY, PNS_INFINITY).numbers;
+    *won = attacker_wins(solver, root, numbers);
+    return settled(numbers);
+}
+
+PnsResult pns_solve(PnsTable* table, Tablebase* tablebase, const Board* board, const PnsLimits* limits) {
+    uint64_t start = now_ns();
+    Solver* solver = calloc(1, sizeof(Solver));
+    PnsResult result = {0};
+    if (solver == NULL) return result;
+    solver->table = table;
+    solver->tablebase = tablebase;
+    solver->max_nodes = limits->max_nodes;
+    solver->deadline = (limits->time_ms != 0) ? start + (uint64_t) limits->time_ms * 1000000u : 0;
+    solver->cancel = limits->cancel;
+
+    // first player to move's win, then opponent's: if neither can be forced it's a draw
+    Player opponent = (board->current_player == human) ? computer : human;
+    bool won = false;
+    if (prove(solver, board, board->current_player, &won) && won) {
+        result.outcome = pns_win;
+    } else if (!solver->stopped && prove(solver, board, opponent, &won)) {
+        result.outcome = won ? pns_loss : pns_draw;
+    }
+    if (result.outcome == pns_win || result.outcome == pns_loss) {
+        result.line_length = winning_line(solver, *board, result.line);
+    }
+    result.nodes = solver->nodes;
+    result.elapsed_us = (now_ns() - start) / 1000;
+    free(solver);
+    return result;
+}
@@ -0,0 +1,81 @@
+#ifndef CHECKERS_V2_PNS_H
+#define CHECKERS_V2_PNS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "bitboard.h"
+#include "ai.h"
+#include "tablebase.h"
+
+/*
+ * Proof-number search solver
+ * --------------------------
+ * depth-first proof-number search (df-pn): proves that a player wins (opponent has no pieces left)
+ * whatever the opponent does, or that it can't. every position has a proof number (how many leaves
+ * at least must still be shown won) and a disproof number (same for not won), search always goes
+ * into the child that is cheapest to settle and backs up once it costs more than its thresholds.
+ * numbers are kept in a fixed-size hash table (buckets of PNS_BUCKET_SIZE, the entry that took the
+ * least work is replaced), so memory is bounded however long it runs; lost entries are searched again.
+ * a draw that comes from repeating a position before the one searched holds only when that position
+ * comes before it again, so such numbers are kept with a hash of the positions they depend on.
+ *
+ * positions in the endgame tablebase, if one is given, are settled from it: proving a draw means going
+ * through every way the attacker can play, with kings that's much of the endgame, over and over.
+ *
+ * game rules are those of the move generator (bitboard.h, same as game.c: jumps are forced, a multi-jump
+ * is one move). player who can't move with pieces left draws (as in game loop), a position
+ * repeated on the current line counts as a draw too, and so does a line longer than MAX_PLY plies
+ */
+
+#define PNS_INFINITY 0x3FFFFFFFu // proof or disproof number of settled position
+#define PNS_BUCKET_SIZE 4
+#define DEFAULT_PNS_MB 64
+
+typedef struct PnsEntry {
+    uint64_t key;      // zobrist key, 0 if entry is empty
+    uint64_t path;     // hash of the loop positions before this one
+    uint32_t proof;    // for player to move: proof that it reaches the goal of its side (attacker: win, defender: no loss)
+    uint32_t disproof;
+    uint32_t work;     // positions searched below this one, the least valuable entry is replaced first
+    uint16_t distance; // proven win: plies until the loser has no pieces, along the proof
+    uint16_t loop;     // numbers hold only when this many positions before it are the same (they come from
+                       // a repetition of one of them or a line too long below), 0 if they hold however it's reached
+} PnsEntry;
+
+typedef struct PnsTable {
+    PnsEntry* entries;
+    uint64_t mask; // bucket count - 1 (bucket count is a power of two)
+} PnsTable;
+
+typedef enum {pns_unknown, pns_win, pns_loss, pns_draw} PnsOutcome;
+
+typedef struct PnsLimits {
+    uint64_t max_nodes;  // 0 means no node limit
+    uint32_t time_ms;    // 0 means no time limit
+    atomic_bool* cancel; // optional
+} PnsLimits;
+
+typedef struct PnsResult {
+    PnsOutcome outcome;  // for player to move, pns_unknown if limits were reached first
+    int line_length;
+    BoardMove line[MAX_PLY]; // with win or loss: moves of both players until the loser has no pieces
+                             // (at most MAX_PLY - 1, shorter if limits are reached while it is made)
+    uint64_t nodes;      // positions searched
+    uint64_t elapsed_us;
+} PnsResult;
+
+/*
+ * Allocates table of (at most) given size in megabytes, returns false if memory can't be allocated
+ */
+bool pns_init(PnsTable* table, size_t megabytes);
+void pns_free(PnsTable* table);
+
+/*
+ * Proves whether player to move in board wins, loses or neither side can force a win (draw).
+ * table is cleared first, tablebase can be NULL. winning line is the quickest win the proof shows, the loser takes the longest
+ * resistance it shows (not necessarily the best play of either side, search stops as soon as a win is certain)
+ */
+PnsResult pns_solve(PnsTable* table, Tablebase* tablebase, const Board* board, const PnsLimits* limits);
+
+#endif //CHECKERS_V2_PNS_H
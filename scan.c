@@ -0,0 +1,117 @@
+#include "scan.h"
+#include "dispatch.h"
+#include <string.h>
+
+#if DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+#define PIECE_KINDS 5
+#define COL_A 0x0101010101010101ull // column 0
+#define COL_B (COL_A << 1)
+#define COL_G (COL_A << 6)
+#define COL_H (COL_A << 7)          // column 7
+#define EVEN_ROW_DARK 0x00AA00AA00AA00AAull // dark cells of rows 0, 2, 4, 6 (odd columns)
+#define ODD_ROW_DARK  0x5500550055005500ull // dark cells of rows 1, 3, 5, 7 (even columns)
+#define BYTES_01 0x0101010101010101ull
+#define BYTES_7F 0x7F7F7F7F7F7F7F7Full
+#define GATHER_MAGIC 0x0102040810204080ull // moves bit 0 of every byte to the top byte, byte i to bit i
+
+typedef void (*ScanKernel)(const int8_t* cells, CellMasks* masks);
+
+typedef struct KernelInfo {
+    KernelHeader header;
+    ScanKernel kernel;
+} KernelInfo;
+
+// no SIMD: 8 cells per uint64_t, bytes equal to piece found with bit tricks (no carries between bytes)
+static void scan_scalar(const int8_t* cells, CellMasks* masks) {
+    memset(masks, 0, sizeof(*masks));
+    for (int row = 0; row < ROW_SIZE; row++) {
+        uint64_t word;
+        memcpy(&word, cells + row * COL_SIZE, sizeof(word));
+        for (int kind = 0; kind < PIECE_KINDS; kind++) {
+            uint64_t x = word ^ ((uint8_t) (kind + black_king) * BYTES_01); // zero bytes where cell holds piece
+            uint64_t zero = ~(((x & BYTES_7F) + BYTES_7F) | x | BYTES_7F);  // 0x80 in zero bytes only
+            masks->pieces[kind] |= (((zero >> 7) * GATHER_MAGIC) >> 56) << (row * COL_SIZE);
+        }
+    }
+}
+
+#if DISPATCH_X86
+__attribute__((target("avx2")))
+static void scan_avx2(const int8_t* cells, CellMasks* masks) {
+    __m256i low = _mm256_loadu_si256((const __m256i*) cells);
+    __m256i high = _mm256_loadu_si256((const __m256i*) (cells + 32));
+    for (int kind = 0; kind < PIECE_KINDS; kind++) {
+        __m256i piece = _mm256_set1_epi8((char) (kind + black_king));
+        uint32_t low_bits = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, piece));
+        uint32_t high_bits = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, piece));
+        masks->pieces[kind] = (uint64_t) high_bits << 32 | low_bits;
+    }
+}
+
+__attribute__((target("avx512bw")))
+static void scan_avx512(const int8_t* cells, CellMasks* masks) {
+    __m512i board = _mm512_loadu_si512((const void*) cells);
+    for (int kind = 0; kind < PIECE_KINDS; kind++) {
+        masks->pieces[kind] = _mm512_cmpeq_epi8_mask(board, _mm512_set1_epi8((char) (kind + black_king)));
+    }
+}
+#endif
+
+// fastest first (see dispatch.h)
+static const KernelInfo kernels[] = {
+#if DISPATCH_X86
+    {{"avx512", cpu_has_avx512bw}, scan_avx512},
+    {{"avx2",   cpu_has_avx2},     scan_avx2},
+#endif
+    {{"scalar", cpu_any},          scan_scalar},
+};
+static KernelTable kernel_table = KERNEL_TABLE(kernels);
+
+void scan_cells(const Game* game, CellMasks* masks) {
+    const KernelInfo* kernel = kernel_current(&kernel_table);
+    kernel->kernel((const int8_t*) game->board, masks);
+}
+
+uint64_t scan_player_cells(const CellMasks* masks, Player player) {
+    return (player == human) ? cell_mask(masks, white) | cell_mask(masks, white_king)
+                             : cell_mask(masks, black) | cell_mask(masks, black_king);
+}
+
+// row - 1 is cell - 8 (white moves up), jumps two cells further in column must not wrap around the board
+bool scan_has_jump(const CellMasks* masks, Player player) {
+    bool white_moves = (player == human);
+    uint64_t men = cell_mask(masks, white_moves ? white : black);
+    uint64_t kings = cell_mask(masks, white_moves ? white_king : black_king);
+    uint64_t opponents = scan_player_cells(masks, white_moves ? computer : human);
+    uint64_t empty = cell_mask(masks, no_piece);
+    uint64_t up = white_moves ? men | kings : kings;
+    uint64_t down = white_moves ? kings : men | kings;
+    uint64_t to_left = ~(COL_A | COL_B);
+    uint64_t to_right = ~(COL_G | COL_H);
+    return ((((up & to_left) >> 9 & opponents) >> 9)
+            | (((up & to_right) >> 7 & opponents) >> 7)
+            | (((down & to_left) << 7 & opponents) << 7)
+            | (((down & to_right) << 9 & opponents) << 9)) & empty;
+}
+
+uint32_t scan_cells_to_squares(uint64_t cells) {
+    // dark cells to even bits of their row's byte, then squeeze out the odd bits
+    uint64_t x = ((cells & EVEN_ROW_DARK) >> 1) | (cells & ODD_ROW_DARK);
+    x = (x | (x >> 1)) & 0x3333333333333333ull;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFull;
+    return (uint32_t) x;
+}
+
+const char* scan_kernel_name(void) {
+    return ((const KernelInfo*) kernel_current(&kernel_table))->header.name;
+}
+
+bool scan_set_kernel(const char* name) {
+    return kernel_select(&kernel_table, name);
+}
@@ -0,0 +1,49 @@
+#ifndef CHECKERS_V2_SCAN_H
+#define CHECKERS_V2_SCAN_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "game.h"
+
+/*
+ * Whole-board scans of Game board
+ * -------------------------------
+ * the 64 int8_t cells of Game board are compared with every piece value at once (AVX-512: one register,
+ * AVX2: two), giving a 64-bit mask per piece kind, bit (row * COL_SIZE + col) set if cell holds it.
+ * counts, occupancy and jump detection are then a few bit operations on masks instead of a walk over cells.
+ * kernel is picked at first use by what CPU supports, scalar loop is used on other CPUs and compilers
+ */
+
+typedef struct CellMasks {
+    uint64_t pieces[5]; // [piece - black_king], [no_piece - black_king] are empty cells (light cells included)
+} CellMasks;
+
+#define cell_mask(masks, piece) ((masks)->pieces[(piece) - black_king])
+
+/*
+ * Fills masks of every piece kind of game board
+ */
+void scan_cells(const Game* game, CellMasks* masks);
+
+/*
+ * Cells of player's pieces (men and kings)
+ */
+uint64_t scan_player_cells(const CellMasks* masks, Player player);
+
+/*
+ * Returns true if player has a jump move
+ */
+bool scan_has_jump(const CellMasks* masks, Player player);
+
+/*
+ * Dark cells of cell mask as bitboard squares (see bitboard.h), light cells are dropped
+ */
+uint32_t scan_cells_to_squares(uint64_t cells);
+
+/*
+ * Kernel scan_cells uses: "avx512", "avx2" or "scalar".
+ * scan_set_kernel picks another one (for benchmarks and tests), false if CPU can't run it
+ */
+const char* scan_kernel_name(void);
+bool scan_set_kernel(const char* name);
+
+#endif //CHECKERS_V2_SCAN_H
@@ -0,0 +1,102 @@
+/*
+ * Position solver
+ * ---------------
+ * usage: solve <position> [-n nodes] [-m milliseconds] [-h hash MB] [-t tablebase] [-c]
+ *
+ * proves with proof-number search (pns.h) whether player to move in position (text form of bitboard.h,
+ * e.g. w:.WW.........w.....b.......BwB...) wins, loses or can only draw, and prints the winning line.
+ *  -n, -m  give up after that many positions or that much time (no limit by default)
+ *  -h      size of proof-number table
+ *  -t      endgame tablebase made by tbgen, positions in it are taken as solved (draws with kings are
+ *          hard to prove by search alone)
+ *  -c      also searches position with alpha-beta (same time limit, 10 s without -m) until it finds
+ *          the game result, to compare how long proving takes with it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ai.h"
+#include "pns.h"
+
+#define COMPARE_TIME_MS 10000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void print_line(const BoardMove* line, int length) {
+    for (int i = 0; i < length; i++) {
+        char move[BOARD_MOVE_STRING_SIZE];
+        board_move_to_string(&line[i], move);
+        printf("%s%s", (i > 0) ? " " : "", move);
+    }
+    printf("\n");
+}
+
+// search stops deepening once score is a won or lost game, tablebase ones too (or time is up)
+static void compare_alpha_beta(const Board* position, uint32_t time_ms) {
+    Board board = *position;
+    SearchLimits limits = {0, time_ms, NULL, NULL};
+    double start = now_seconds();
+    SearchResult result = search_iterative(&board, &limits);
+    double seconds = now_seconds() - start;
+    bool settled = ai_is_known_result(result.score);
+    printf("alpha-beta: %s at depth %d, score %d, %llu nodes in %.3fs\n",
+           settled ? (result.score > 0 ? "win" : "loss") : "no result", result.depth, result.score,
+           (unsigned long long) result.nodes, seconds);
+}
+
+int main(int argc, char* argv[]) {
+    const char* position = NULL;
+    PnsLimits limits = {0, 0, NULL};
+    size_t hash_mb = DEFAULT_PNS_MB;
+    const char* tablebase_path = NULL;
+    bool compare = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) limits.max_nodes = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) limits.time_ms = (uint32_t) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) hash_mb = (size_t) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) tablebase_path = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0) compare = true;
+        else if (position == NULL && argv[i][0] != '-') position = argv[i];
+        else position = NULL, i = argc; // unknown option, usage below
+    }
+    Board board;
+    if (position == NULL || !board_from_string(&board, position)) {
+        fprintf(stderr, "usage: %s <position> [-n nodes] [-m milliseconds] [-h hash MB] [-t tablebase] [-c]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    Tablebase* tablebase = NULL;
+    if (tablebase_path != NULL && (tablebase = tb_open(tablebase_path)) == NULL) {
+        fprintf(stderr, "can't read tablebase %s\n", tablebase_path);
+        return EXIT_FAILURE;
+    }
+    PnsTable table;
+    if (hash_mb == 0 || !pns_init(&table, hash_mb)) {
+        fprintf(stderr, "can't allocate %zu MB table\n", hash_mb);
+        return EXIT_FAILURE;
+    }
+
+    PnsResult result = pns_solve(&table, tablebase, &board, &limits);
+    static const char* outcomes[] = {"unknown (limit reached)", "win", "loss", "draw"};
+    double seconds = (double) result.elapsed_us / 1e6;
+    printf("%s to move: %s, %llu nodes in %.3fs (%.0f nps)\n", (board.current_player == human) ? "white" : "black",
+           outcomes[result.outcome], (unsigned long long) result.nodes, seconds,
+           (seconds > 0) ? (double) result.nodes / seconds : 0.0);
+    if (result.line_length > 0) {
+        printf("line (%d plies): ", result.line_length);
+        print_line(result.line, result.line_length);
+    }
+    pns_free(&table);
+    tb_close(tablebase);
+
+    if (compare) {
+        if (tablebase_path != NULL) ai_load_tablebase(tablebase_path);
+        compare_alpha_beta(&board, (limits.time_ms != 0) ? limits.time_ms : COMPARE_TIME_MS);
+    }
+    return EXIT_SUCCESS;
+}
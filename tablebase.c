@@ -0,0 +1,347 @@
+#include "tablebase.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MEN_SQUARES 28                // squares a man of one color can stand on
+#define BLACK_MEN_SQUARES 0x0FFFFFFFu // black men never stand on row 7
+#define EMPTY_SLOT UINT64_MAX
+
+static uint64_t binomials[SQUARE_COUNT + 1][SQUARE_COUNT + 1];
+static pthread_once_t binomials_once = PTHREAD_ONCE_INIT;
+
+static void init_binomials(void) {
+    for (int n = 0; n <= SQUARE_COUNT; n++) {
+        binomials[n][0] = 1;
+        for (int k = 1; k <= n; k++) binomials[n][k] = binomials[n - 1][k - 1] + (k < n ? binomials[n - 1][k] : 0);
+    }
+}
+
+uint64_t tb_binomial(int n, int k) {
+    pthread_once(&binomials_once, init_binomials);
+    return (k < 0 || k > n) ? 0 : binomials[n][k];
+}
+
+static inline int popcount(Bitboard b) {
+    return __builtin_popcount(b);
+}
+
+// combinatorial (colex) rank of set of squares: sum of binomial(square, i) for i-th lowest square
+static uint64_t rank_squares(uint32_t mask) {
+    uint64_t rank = 0;
+    for (int i = 1; mask; mask &= mask - 1, i++) rank += binomials[__builtin_ctz(mask)][i];
+    return rank;
+}
+
+// set of count squares below n with given rank
+static uint32_t unrank_squares(uint64_t rank, int count, int n) {
+    uint32_t mask = 0;
+    for (int k = count; k > 0; k--) {
+        int square = k - 1;
+        while (square + 1 < n && binomials[square + 1][k] <= rank) square++;
+        rank -= binomials[square][k];
+        mask |= 1u << square;
+        n = square;
+    }
+    return mask;
+}
+
+// bit i of result tells whether i-th square of space is in mask
+static uint32_t compress_squares(uint32_t mask, uint32_t space) {
+    uint32_t result = 0;
+    for (int i = 0; space; space &= space - 1, i++) {
+        if (mask & space & -space) result |= 1u << i;
+    }
+    return result;
+}
+
+// inverse of compress_squares
+static uint32_t expand_squares(uint32_t compressed, uint32_t space) {
+    uint32_t result = 0;
+    for (int i = 0; space; space &= space - 1, i++) {
+        if ((compressed >> i) & 1) result |= space & -space;
+    }
+    return result;
+}
+
+static uint32_t reverse_bits(uint32_t b) {
+    b = ((b >> 1) & 0x55555555u) | ((b & 0x55555555u) << 1);
+    b = ((b >> 2) & 0x33333333u) | ((b & 0x33333333u) << 2);
+    b = ((b >> 4) & 0x0F0F0F0Fu) | ((b & 0x0F0F0F0Fu) << 4);
+    b = ((b >> 8) & 0x00FF00FFu) | ((b & 0x00FF00FFu) << 8);
+    return (b >> 16) | (b << 16);
+}
+
+TBSignature tb_signature(const Board* board) {
+    TBSignature signature = {
+        (uint8_t) popcount(board->white & ~board->kings), (uint8_t) popcount(board->white & board->kings),
+        (uint8_t) popcount(board->black & ~board->kings), (uint8_t) popcount(board->black & board->kings)
+    };
+    return signature;
+}
+
+int tb_signature_code(TBSignature signature) {
+    const int n = TB_MAX_PIECES + 1;
+    return ((signature.white_men * n + signature.white_kings) * n + signature.black_men) * n + signature.black_kings;
+}
+
+uint64_t tb_table_size(TBSignature signature) {
+    int free_count = SQUARE_COUNT - signature.white_men - signature.black_men;
+    return tb_binomial(MEN_SQUARES, signature.white_men) * tb_binomial(MEN_SQUARES, signature.black_men)
+           * tb_binomial(free_count, signature.white_kings)
+           * tb_binomial(free_count - signature.white_kings, signature.black_kings);
+}
+
+uint64_t tb_index(const Board* board, TBSignature signature) {
+    pthread_once(&binomials_once, init_binomials);
+    Bitboard white_men = board->white & ~board->kings;
+    Bitboard black_men = board->black & ~board->kings;
+    Bitboard white_kings = board->white & board->kings;
+    Bitboard free = ~(white_men | black_men);
+    int free_count = SQUARE_COUNT - signature.white_men - signature.black_men;
+
+    uint64_t index = rank_squares(white_men >> (SQUARE_COUNT - MEN_SQUARES));
+    index = index * binomials[MEN_SQUARES][signature.black_men] + rank_squares(black_men & BLACK_MEN_SQUARES);
+    index = index * binomials[free_count][signature.white_kings] + rank_squares(compress_squares(white_kings, free));
+    index = index * binomials[free_count - signature.white_kings][signature.black_kings]
+            + rank_squares(compress_squares(board->black & board->kings, free & ~white_kings));
+    return index;
+}
+
+bool tb_unindex(TBSignature signature, uint64_t index, Board* board) {
+    pthread_once(&binomials_once, init_binomials);
+    int free_count = SQUARE_COUNT - signature.white_men - signature.black_men;
+    uint64_t black_kings_count = binomials[free_count - signature.white_kings][signature.black_kings];
+    uint64_t white_kings_count = binomials[free_count][signature.white_kings];
+    uint64_t black_men_count = binomials[MEN_SQUARES][signature.black_men];
+
+    uint64_t black_kings_rank = index % black_kings_count;
+    index /= black_kings_count;
+    uint64_t white_kings_rank = index % white_kings_count;
+    index /= white_kings_count;
+    uint64_t black_men_rank = index % black_men_count;
+    index /= black_men_count;
+
+    Bitboard white_men = unrank_squares(index, signature.white_men, MEN_SQUARES) << (SQUARE_COUNT - MEN_SQUARES);
+    Bitboard black_men = unrank_squares(black_men_rank, signature.black_men, MEN_SQUARES);
+    if (white_men & black_men) return false;
+    Bitboard free = ~(white_men | black_men);
+    Bitboard white_kings = expand_squares(unrank_squares(white_kings_rank, signature.white_kings, free_count), free);
+    Bitboard black_kings = expand_squares(unrank_squares(black_kings_rank, signature.black_kings,
+                                                         free_count - signature.white_kings), free & ~white_kings);
+    board->white = white_men | white_kings;
+    board->black = black_men | black_kings;
+    board->kings = white_kings | black_kings;
+    board->current_player = human;
+    board->key = 0;
+    board->value = 0;
+    return true;
+}
+
+void tb_flip(Board* board) {
+    // square s of one side is square 31 - s of the other
+    Bitboard white = board->white;
+    board->white = reverse_bits(board->black);
+    board->black = reverse_bits(white);
+    board->kings = reverse_bits(board->kings);
+    board->current_player = (board->current_player == human) ? computer : human;
+}
+
+// winner makes the last move, so wins take odd number of plies and losses even, distance is stored in moves
+uint8_t tb_encode_value(const TBValue* value) {
+    if (value->outcome == TB_RESULT_WIN) return (uint8_t) ((value->distance + 1) / 2);
+    if (value->outcome == TB_RESULT_LOSS) return (uint8_t) (TB_LOSS + value->distance / 2);
+    return 0;
+}
+
+void tb_decode_value(uint8_t byte, TBValue* value) {
+    if (byte == 0) {
+        value->outcome = TB_RESULT_DRAW;
+        value->distance = 0;
+    } else if (byte < TB_LOSS) {
+        value->outcome = TB_RESULT_WIN;
+        value->distance = 2 * byte - 1;
+    } else {
+        value->outcome = TB_RESULT_LOSS;
+        value->distance = 2 * (byte - TB_LOSS);
+    }
+}
+
+// block is sequence of (run length - 1, value) pairs
+size_t tb_encode_block(const uint8_t* values, int count, uint8_t* out) {
+    size_t size = 0;
+    for (int i = 0; i < count;) {
+        int run = 1;
+        while (i + run < count && run < 256 && values[i + run] == values[i]) run++;
+        out[size++] = (uint8_t) (run - 1);
+        out[size++] = values[i];
+        i += run;
+    }
+    return size;
+}
+
+static void decode_block(const uint8_t* in, size_t size, uint8_t* out, int count) {
+    int filled = 0;
+    for (size_t i = 0; i + 1 < size && filled < count; i += 2) {
+        int run = in[i] + 1;
+        if (run > count - filled) run = count - filled;
+        memset(out + filled, in[i + 1], run);
+        filled += run;
+    }
+    memset(out + filled, 0, count - filled);
+}
+
+static uint64_t read_offset(const Tablebase* tb, const TBTableHeader* table, uint32_t block) {
+    uint64_t offset;
+    memcpy(&offset, tb->map + table->blocks_offset + block * sizeof(uint64_t), sizeof(offset));
+    return offset;
+}
+
+static bool valid_file(const uint8_t* map, size_t size) {
+    if (size < sizeof(TBFileHeader)) return false;
+    const TBFileHeader* header = (const TBFileHeader*) map;
+    if (memcmp(header->magic, TB_MAGIC, 4) != 0 || header->version != TB_VERSION) return false;
+    if (header->max_pieces > TB_MAX_PIECES || header->directory_offset % sizeof(uint64_t) != 0) return false;
+    if (header->directory_offset > size
+        || (size - header->directory_offset) / sizeof(TBTableHeader) < header->table_count) return false;
+    const TBTableHeader* tables = (const TBTableHeader*) (map + header->directory_offset);
+    for (uint32_t i = 0; i < header->table_count; i++) {
+        const TBTableHeader* table = &tables[i];
+        const TBSignature* s = &table->signature;
+        if (s->white_men + s->white_kings + s->black_men + s->black_kings > (int) header->max_pieces) return false;
+        if (table->size != tb_table_size(*s)) return false;
+        if (table->block_count != (table->size + TB_BLOCK_SIZE - 1) / TB_BLOCK_SIZE) return false;
+        if (table->blocks_offset > size
+            || (size - table->blocks_offset) / sizeof(uint64_t) < (uint64_t) table->block_count + 1) return false;
+    }
+    return true;
+}
+
+Tablebase* tb_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // mapping stays valid
+    if (map == MAP_FAILED) return NULL;
+
+    Tablebase* tb = calloc(1, sizeof(Tablebase));
+    if (tb != NULL) tb->slots = malloc(TB_CACHE_BLOCKS * sizeof(TBCacheSlot));
+    if (tb == NULL || tb->slots == NULL || !valid_file(map, st.st_size)) {
+        if (tb != NULL) free(tb->slots);
+        free(tb);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    tb->map = map;
+    tb->map_size = st.st_size;
+    tb->header = (const TBFileHeader*) tb->map;
+    tb->tables = (const TBTableHeader*) (tb->map + tb->header->directory_offset);
+    for (int i = 0; i < TB_SIGNATURE_CODES; i++) tb->table_of[i] = -1;
+    for (uint32_t i = 0; i < tb->header->table_count; i++) tb->table_of[tb_signature_code(tb->tables[i].signature)] = (int16_t) i;
+
+    for (int stripe = 0; stripe < TB_CACHE_STRIPES; stripe++) {
+        TBCacheStripe* cache = &tb->stripes[stripe];
+        pthread_mutex_init(&cache->lock, NULL);
+        cache->slots = &tb->slots[stripe * TB_STRIPE_BLOCKS];
+        for (int i = 0; i < TB_STRIPE_BLOCKS; i++) {
+            cache->hash[i] = -1;
+            cache->slots[i].key = EMPTY_SLOT;
+            cache->slots[i].hash_next = -1;
+            cache->slots[i].newer = i - 1;
+            cache->slots[i].older = (i + 1 < TB_STRIPE_BLOCKS) ? i + 1 : -1;
+        }
+        cache->newest = 0;
+        cache->oldest = TB_STRIPE_BLOCKS - 1;
+    }
+    return tb;
+}
+
+void tb_close(Tablebase* tb) {
+    if (tb == NULL) return;
+    munmap((void*) tb->map, tb->map_size);
+    for (int stripe = 0; stripe < TB_CACHE_STRIPES; stripe++) pthread_mutex_destroy(&tb->stripes[stripe].lock);
+    free(tb->slots);
+    free(tb);
+}
+
+int tb_max_pieces(const Tablebase* tb) {
+    return (int) tb->header->max_pieces;
+}
+
+// low bits of hash pick stripe, the rest hash chain within it
+static uint32_t hash_of(uint64_t key) {
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15u) >> 32);
+}
+
+static int bucket_of(uint64_t key) {
+    return (int) (hash_of(key) / TB_CACHE_STRIPES % TB_STRIPE_BLOCKS);
+}
+
+static void unlink_lru(TBCacheStripe* cache, int slot) {
+    TBCacheSlot* s = &cache->slots[slot];
+    if (s->newer >= 0) cache->slots[s->newer].older = s->older; else cache->newest = s->older;
+    if (s->older >= 0) cache->slots[s->older].newer = s->newer; else cache->oldest = s->newer;
+}
+
+static void make_newest(TBCacheStripe* cache, int slot) {
+    if (cache->newest == slot) return;
+    unlink_lru(cache, slot);
+    cache->slots[slot].newer = -1;
+    cache->slots[slot].older = cache->newest;
+    cache->slots[cache->newest].newer = slot;
+    cache->newest = slot;
+}
+
+static void unlink_hash(TBCacheStripe* cache, int slot) {
+    int* link = &cache->hash[bucket_of(cache->slots[slot].key)];
+    while (*link != slot) link = &cache->slots[*link].hash_next;
+    *link = cache->slots[slot].hash_next;
+}
+
+// decoded block from cache stripe, its least recently used block makes room if it isn't there. stripe must be locked
+static const uint8_t* cached_block(const Tablebase* tb, TBCacheStripe* cache, int table, uint32_t block) {
+    uint64_t key = (uint64_t) table << 32 | block;
+    int bucket = bucket_of(key);
+    int slot = cache->hash[bucket];
+    while (slot >= 0 && cache->slots[slot].key != key) slot = cache->slots[slot].hash_next;
+    if (slot < 0) {
+        slot = cache->oldest;
+        TBCacheSlot* s = &cache->slots[slot];
+        if (s->key != EMPTY_SLOT) unlink_hash(cache, slot);
+        const TBTableHeader* header = &tb->tables[table];
+        uint64_t start = read_offset(tb, header, block);
+        uint64_t end = read_offset(tb, header, block + 1);
+        if (end > tb->map_size || start > end) end = start; // damaged file, block reads as draws
+        uint64_t values = header->size - (uint64_t) block * TB_BLOCK_SIZE;
+        decode_block(tb->map + start, end - start, s->values, values < TB_BLOCK_SIZE ? (int) values : TB_BLOCK_SIZE);
+        s->key = key;
+        s->hash_next = cache->hash[bucket];
+        cache->hash[bucket] = slot;
+    }
+    make_newest(cache, slot);
+    return cache->slots[slot].values;
+}
+
+bool tb_probe(Tablebase* tb, const Board* board, TBValue* value) {
+    if (popcount(board->white | board->black) > (int) tb->header->max_pieces) return false;
+    Board position = *board;
+    if (position.current_player == computer) tb_flip(&position);
+    if (position.white == 0 || position.black == 0) return false; // game is over, not in tables
+    int table = tb->table_of[tb_signature_code(tb_signature(&position))];
+    if (table < 0) return false;
+    uint64_t index = tb_index(&position, tb->tables[table].signature);
+
+    uint32_t block = (uint32_t) (index / TB_BLOCK_SIZE);
+    TBCacheStripe* cache = &tb->stripes[hash_of((uint64_t) table << 32 | block) % TB_CACHE_STRIPES];
+    pthread_mutex_lock(&cache->lock);
+    const uint8_t* values = cached_block(tb, cache, table, block);
+    uint8_t byte = values[index % TB_BLOCK_SIZE];
+    pthread_mutex_unlock(&cache->lock);
+    tb_decode_value(byte, value);
+    return true;
+}
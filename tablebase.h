@@ -0,0 +1,145 @@
+#ifndef CHECKERS_V2_TABLEBASE_H
+#define CHECKERS_V2_TABLEBASE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "bitboard.h"
+
+/*
+ * Endgame tablebase
+ * -----------------
+ * exact result (win/loss/draw) and distance to win of every position with few pieces,
+ * generated offline by tbgen (retrograde analysis) and probed by search.
+ *
+ * only positions with white (human) to move are stored, position with black to move is looked up
+ * through its mirror image (board turned around, colors swapped, see tb_flip).
+ * positions with the same material (numbers of white men, white kings, black men, black kings)
+ * form a table. index of position in its table is made of combinatorial ranks of white men
+ * (squares 4..31, white men never stand on row 0), black men (squares 0..27), white kings
+ * (among squares men left free) and black kings (among squares still free).
+ * men of both colors are ranked independently, so some indexes are not positions (two men on one square).
+ *
+ * every position is one value byte: 0 draw, 1..127 win in that many moves (2 * moves - 1 plies),
+ * TB_LOSS + m loss in m moves (2 * m plies). player to move loses when all its pieces are taken.
+ *
+ * file (native byte order): TBFileHeader, tables as blocks of TB_BLOCK_SIZE run-length encoded values,
+ * for every table array of its block offsets (one more than blocks, last one is end of last block),
+ * then TBTableHeader of every table (directory). file is mmap'ed, decoded blocks are kept in LRU cache,
+ * split into stripes with their own lock and LRU list so threads probing different blocks rarely wait.
+ */
+
+#define TB_MAGIC "CKTB"
+#define TB_VERSION 2
+#define TB_MAX_PIECES 8       // index arithmetic is sized for this many pieces
+#define TB_MAX_DISTANCE 254  // plies, longest loss that fits in value byte
+#define TB_LOSS 128
+#define TB_BLOCK_SIZE 4096    // positions per block
+#define TB_CACHE_BLOCKS 2048  // decoded blocks kept in memory (8 MB)
+#define TB_CACHE_STRIPES 64   // parts of cache with own lock, block's hash picks one
+#define TB_STRIPE_BLOCKS (TB_CACHE_BLOCKS / TB_CACHE_STRIPES)
+
+typedef enum {TB_RESULT_DRAW, TB_RESULT_WIN, TB_RESULT_LOSS} TBOutcome;
+
+typedef struct TBValue {
+    TBOutcome outcome; // for player to move
+    int distance;      // plies until player who wins takes the last piece (0 for draw)
+} TBValue;
+
+typedef struct TBSignature {
+    uint8_t white_men;
+    uint8_t white_kings;
+    uint8_t black_men;
+    uint8_t black_kings;
+} TBSignature;
+
+typedef struct TBFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t max_pieces;       // every position with this many pieces or less is in the file
+    uint32_t table_count;
+    uint64_t directory_offset; // offset of table_count TBTableHeaders
+} TBFileHeader;
+
+typedef struct TBTableHeader {
+    TBSignature signature;
+    uint32_t block_count;
+    uint64_t size;             // positions (indexes) in table
+    uint64_t blocks_offset;    // offset of block_count + 1 block offsets (uint64_t)
+} TBTableHeader;
+
+typedef struct TBCacheSlot {
+    uint64_t key;              // table << 32 | block, UINT64_MAX if slot is empty
+    int hash_next;             // next slot in the same hash chain
+    int newer, older;          // LRU list
+    uint8_t values[TB_BLOCK_SIZE];
+} TBCacheSlot;
+
+typedef struct TBCacheStripe {
+    pthread_mutex_t lock;
+    TBCacheSlot* slots;                   // TB_STRIPE_BLOCKS slots, slot numbers are within stripe
+    int hash[TB_STRIPE_BLOCKS];           // first slot of every hash chain
+    int newest, oldest;
+} TBCacheStripe;
+
+#define TB_SIGNATURE_CODES ((TB_MAX_PIECES + 1) * (TB_MAX_PIECES + 1) * (TB_MAX_PIECES + 1) * (TB_MAX_PIECES + 1))
+
+typedef struct Tablebase {
+    const uint8_t* map;
+    size_t map_size;
+    const TBFileHeader* header;
+    const TBTableHeader* tables;
+    int16_t table_of[TB_SIGNATURE_CODES]; // table number of every signature, -1 if file doesn't have it
+    TBCacheSlot* slots;                   // all slots, stripes use consecutive parts of them
+    TBCacheStripe stripes[TB_CACHE_STRIPES]; // probes come from all search threads
+} Tablebase;
+
+/*
+ * Number of ways to choose k of n
+ */
+uint64_t tb_binomial(int n, int k);
+
+/*
+ * Material of position (white to move)
+ */
+TBSignature tb_signature(const Board* board);
+int tb_signature_code(TBSignature signature);
+uint64_t tb_table_size(TBSignature signature);
+
+/*
+ * Index of position (white to move) in table of its signature
+ */
+uint64_t tb_index(const Board* board, TBSignature signature);
+
+/*
+ * Position with white to move of given index, false if index is not a position
+ */
+bool tb_unindex(TBSignature signature, uint64_t index, Board* board);
+
+/*
+ * Turns board around and swaps colors (player to move too), key and value are not updated
+ */
+void tb_flip(Board* board);
+
+uint8_t tb_encode_value(const TBValue* value);
+void tb_decode_value(uint8_t byte, TBValue* value);
+
+/*
+ * Run-length encodes count values into out (at most 2 * count bytes), returns encoded size
+ */
+size_t tb_encode_block(const uint8_t* values, int count, uint8_t* out);
+
+/*
+ * Opens tablebase file, NULL if it can't be read or isn't a tablebase
+ */
+Tablebase* tb_open(const char* path);
+void tb_close(Tablebase* tb);
+int tb_max_pieces(const Tablebase* tb);
+
+/*
+ * Looks position up, false if it isn't in tablebase (too many pieces)
+ * safe to call from several threads
+ */
+bool tb_probe(Tablebase* tb, const Board* board, TBValue* value);
+
+#endif //CHECKERS_V2_TABLEBASE_H
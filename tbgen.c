@@ -0,0 +1,394 @@
+/*
+ * Endgame tablebase generator
+ * ---------------------------
+ * usage: tbgen <max pieces> <output file> [threads]
+ *
+ * solves every position with max pieces or less by retrograde analysis and writes tablebase file
+ * (see tablebase.h). tables are solved from fewer pieces to more and, with the same number of pieces,
+ * from fewer men to more, so captures and promotions always lead to tables that are solved already.
+ * table and its mirror (colors swapped, e.g. 2 kings vs 1 king and 1 king vs 2 kings) lead into each other
+ * through quiet moves and are solved together:
+ *  - every position is looked at once (by all threads): moves that capture or promote get their values
+ *    from solved tables, quiet moves are counted
+ *  - then positions are settled in order of distance. when position is settled, positions one quiet move
+ *    before it (found by taking the move back) learn about it: they are won one ply later if it is lost,
+ *    or lose one more undecided move if it is won. position that has no undecided moves left is lost
+ *  - positions never settled are draws
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tablebase.h"
+#include "threadpool.h"
+#include "vector.h"
+
+#define CHUNK_SIZE (1 << 16) // positions per task of first look
+#define SECOND_TABLE (1u << 31) // queue entries: index of position, this bit set if it's in the mirror table
+
+typedef struct Table {
+    TBSignature signature;
+    uint64_t size;
+    uint8_t* values;  // settled values (0 is draw or not settled yet)
+    uint8_t* counts;  // while solving: moves not known to lead to a position opponent wins
+    uint8_t* pending; // while solving: best result found so far (encoded value), loss is only final when count is 0
+} Table;
+
+typedef struct Group {
+    Table* tables[2];
+    int size;         // 1 if table is its own mirror
+    vector queues[TB_MAX_DISTANCE + 1]; // [distance] positions that may be settled at that distance
+} Group;
+
+typedef struct LookTask {
+    Table* table;
+    uint64_t begin, end;
+} LookTask;
+
+static Table* tables[TB_SIGNATURE_CODES];
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void fail(const char* message) {
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// value of position after white's move, from the point of view of black (who is to move then)
+static uint8_t successor_value(const Board* board, const BoardMove* move) {
+    Board next = *board;
+    apply_move(&next, move);
+    tb_flip(&next); // black to move becomes white to move
+    if (next.white == 0) return TB_LOSS; // all pieces taken
+    TBSignature signature = tb_signature(&next);
+    const Table* table = tables[tb_signature_code(signature)];
+    return table->values[tb_index(&next, signature)];
+}
+
+// first look at positions: results of captures and promotions, number of quiet moves
+static void look_at_chunk(void* arg) {
+    const LookTask* task = arg;
+    Table* table = task->table;
+    for (uint64_t index = task->begin; index < task->end; index++) {
+        Board board;
+        if (!tb_unindex(table->signature, index, &board)) continue;
+        BoardMoveList moves;
+        board_moves(&board, &moves);
+        int count = 0;
+        int win = 0;  // shortest win through capture or promotion
+        int loss = 0; // longest loss, if everything loses
+        for (int i = 0; i < moves.count; i++) {
+            const BoardMove* move = &moves.moves[i];
+            if (move->captured == 0 && !move->promotes) {
+                count++; // stays in this group, not known yet
+                continue;
+            }
+            TBValue value;
+            tb_decode_value(successor_value(&board, move), &value);
+            if (value.outcome == TB_RESULT_LOSS && (win == 0 || value.distance + 1 < win)) win = value.distance + 1;
+            if (value.outcome == TB_RESULT_WIN && value.distance + 1 > loss) loss = value.distance + 1;
+            if (value.outcome != TB_RESULT_WIN) count++;
+        }
+        // player who can't move gets a draw, nothing is pending then
+        TBValue pending = {TB_RESULT_DRAW, 0};
+        if (win != 0) pending = (TBValue) {TB_RESULT_WIN, win};
+        else if (loss != 0) pending = (TBValue) {TB_RESULT_LOSS, loss};
+        if (pending.distance > TB_MAX_DISTANCE) fail("distance to win doesn't fit in tablebase");
+        table->counts[index] = (uint8_t) count;
+        table->pending[index] = tb_encode_value(&pending);
+    }
+}
+
+static Table* new_table(TBSignature signature) {
+    Table* table = malloc(sizeof(Table));
+    if (table == NULL) return NULL;
+    table->signature = signature;
+    table->size = tb_table_size(signature);
+    table->values = calloc(table->size, 1);
+    table->counts = calloc(table->size, 1);
+    table->pending = calloc(table->size, 1);
+    if (table->values == NULL || table->counts == NULL || table->pending == NULL) {
+        free(table->values);
+        free(table->counts);
+        free(table->pending);
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+static void look_at_group(ThreadPool* pool, Group* group) {
+    uint64_t task_count = 0;
+    for (int t = 0; t < group->size; t++) task_count += (group->tables[t]->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    LookTask* tasks = malloc(task_count * sizeof(LookTask));
+    if (tasks == NULL) fail("out of memory");
+    TaskGroup task_group;
+    task_group_init(&task_group);
+    uint64_t n = 0;
+    for (int t = 0; t < group->size; t++) {
+        Table* table = group->tables[t];
+        for (uint64_t begin = 0; begin < table->size; begin += CHUNK_SIZE) {
+            tasks[n] = (LookTask) {table, begin, (begin + CHUNK_SIZE < table->size) ? begin + CHUNK_SIZE : table->size};
+            threadpool_submit(pool, &task_group, look_at_chunk, &tasks[n]);
+            n++;
+        }
+    }
+    threadpool_wait(pool, &task_group);
+    free(tasks);
+}
+
+static void enqueue(Group* group, int t, uint64_t index, int distance) {
+    if (distance > TB_MAX_DISTANCE) fail("distance to win doesn't fit in tablebase");
+    uint32_t entry = (uint32_t) index | (t == 1 ? SECOND_TABLE : 0);
+    VectorAppend(&group->queues[distance], &entry);
+}
+
+// settled position is one move (of player who was to move there) after position in table t
+static void update_predecessor(Group* group, int t, const Board* board, const TBValue* settled) {
+    Table* table = group->tables[t];
+    uint64_t index = tb_index(board, table->signature);
+    if (table->values[index] != 0) return;
+    TBValue pending;
+    tb_decode_value(table->pending[index], &pending);
+    if (settled->outcome == TB_RESULT_LOSS) {
+        if (pending.outcome == TB_RESULT_WIN && pending.distance <= settled->distance + 1) return;
+        pending = (TBValue) {TB_RESULT_WIN, settled->distance + 1};
+        table->pending[index] = tb_encode_value(&pending);
+        enqueue(group, t, index, pending.distance);
+    } else {
+        table->counts[index]--;
+        if (pending.outcome == TB_RESULT_WIN) return;
+        if (pending.outcome != TB_RESULT_LOSS || pending.distance < settled->distance + 1) {
+            pending = (TBValue) {TB_RESULT_LOSS, settled->distance + 1};
+            table->pending[index] = tb_encode_value(&pending);
+        }
+        if (table->counts[index] == 0) enqueue(group, t, index, pending.distance);
+    }
+}
+
+/*
+ * Finds positions from which quiet move leads to position index of table t by taking the move back:
+ * position with white to move is mirrored, so white piece has just moved. white man came from the row
+ * below, king from any side, and the move was only allowed if there was no jump (jumps are forced).
+ * man that reached last row would have been crowned (other table), so only kings are taken back there
+ */
+static void update_predecessors(Group* group, int t, uint64_t index, const TBValue* settled) {
+    Board after;
+    tb_unindex(group->tables[t]->signature, index, &after);
+    tb_flip(&after);
+    Bitboard empty = ~(after.white | after.black);
+    for (Bitboard pieces = after.white; pieces; pieces &= pieces - 1) {
+        int sq = __builtin_ctz(pieces);
+        Bitboard bit = 1u << sq;
+        bool king = (after.kings & bit) != 0;
+        for (int row_step = king ? -1 : 1; row_step <= 1; row_step += 2) {
+            for (int col_step = -1; col_step <= 1; col_step += 2) {
+                int row = square_row(sq) + row_step;
+                int col = square_col(sq) + col_step;
+                if (row < 0 || row > 7 || col < 0 || col > 7) continue;
+                Bitboard origin = 1u << square_of(row, col);
+                if (!(empty & origin)) continue;
+                Board before = after;
+                before.white = (before.white & ~bit) | origin;
+                if (king) before.kings = (before.kings & ~bit) | origin;
+                before.current_player = human;
+                if (board_has_captures(&before)) continue;
+                TBSignature signature = tb_signature(&before);
+                int before_t = (group->size == 2 && tb_signature_code(signature) == tb_signature_code(group->tables[1]->signature)) ? 1 : 0;
+                update_predecessor(group, before_t, &before, settled);
+            }
+        }
+    }
+}
+
+static TBSignature mirror(TBSignature s) {
+    TBSignature m = {s.black_men, s.black_kings, s.white_men, s.white_kings};
+    return m;
+}
+
+static void print_signature(TBSignature s) {
+    printf("%dm%dk vs %dm%dk", s.white_men, s.white_kings, s.black_men, s.black_kings);
+}
+
+// solves table of signature together with its mirror
+static void solve_group(ThreadPool* pool, TBSignature signature) {
+    double start = now_seconds();
+    Group group;
+    group.size = 0;
+    TBSignature members[2] = {signature, mirror(signature)};
+    int members_count = (tb_signature_code(members[0]) == tb_signature_code(members[1])) ? 1 : 2;
+    for (int i = 0; i < members_count; i++) {
+        if (tb_table_size(members[i]) > SECOND_TABLE) fail("table is too large to solve");
+        Table* table = new_table(members[i]);
+        if (table == NULL) fail("out of memory");
+        tables[tb_signature_code(members[i])] = table;
+        group.tables[group.size++] = table;
+    }
+    for (int d = 0; d <= TB_MAX_DISTANCE; d++) VectorNew(&group.queues[d], sizeof(uint32_t), NULL, 0);
+
+    look_at_group(pool, &group);
+    for (int t = 0; t < group.size; t++) {
+        const Table* table = group.tables[t];
+        for (uint64_t i = 0; i < table->size; i++) {
+            TBValue pending;
+            tb_decode_value(table->pending[i], &pending);
+            if (pending.outcome == TB_RESULT_WIN || (pending.outcome == TB_RESULT_LOSS && table->counts[i] == 0)) {
+                enqueue(&group, t, i, pending.distance);
+            }
+        }
+    }
+
+    // queues only grow at distances above the one being settled
+    for (int d = 1; d <= TB_MAX_DISTANCE; d++) {
+        vector* queue = &group.queues[d];
+        for (int i = 0; i < VectorLength(queue); i++) {
+            uint32_t entry = *(const uint32_t*) VectorNth(queue, i);
+            int t = (entry & SECOND_TABLE) ? 1 : 0;
+            uint64_t index = entry & ~SECOND_TABLE;
+            Table* table = group.tables[t];
+            TBValue pending;
+            tb_decode_value(table->pending[index], &pending);
+            if (table->values[index] != 0 || pending.distance != d) continue; // settled earlier
+            table->values[index] = table->pending[index];
+            update_predecessors(&group, t, index, &pending);
+        }
+        VectorClear(queue);
+    }
+    for (int d = 0; d <= TB_MAX_DISTANCE; d++) VectorDispose(&group.queues[d]);
+
+    for (int t = 0; t < group.size; t++) {
+        Table* table = group.tables[t];
+        uint64_t wins = 0, losses = 0, positions = 0;
+        int longest = 0;
+        for (uint64_t i = 0; i < table->size; i++) {
+            Board board;
+            if (!tb_unindex(table->signature, i, &board)) continue;
+            positions++;
+            TBValue value;
+            tb_decode_value(table->values[i], &value);
+            if (value.outcome == TB_RESULT_WIN) wins++;
+            if (value.outcome == TB_RESULT_LOSS) losses++;
+            if (value.distance > longest) longest = value.distance;
+        }
+        print_signature(table->signature);
+        printf(": %llu positions, %llu won, %llu lost, %llu drawn, longest win %d plies (%.1fs)\n",
+               (unsigned long long) positions, (unsigned long long) wins, (unsigned long long) losses,
+               (unsigned long long) (positions - wins - losses), longest, now_seconds() - start);
+        free(table->counts);
+        free(table->pending);
+        table->counts = table->pending = NULL;
+    }
+}
+
+// orders signatures by pieces, then by men (captures and promotions only lead to earlier signatures)
+static int compare_signatures(const void* lhs, const void* rhs) {
+    const TBSignature* a = lhs;
+    const TBSignature* b = rhs;
+    int pieces_a = a->white_men + a->white_kings + a->black_men + a->black_kings;
+    int pieces_b = b->white_men + b->white_kings + b->black_men + b->black_kings;
+    if (pieces_a != pieces_b) return pieces_a - pieces_b;
+    int men_a = a->white_men + a->black_men;
+    int men_b = b->white_men + b->black_men;
+    if (men_a != men_b) return men_a - men_b;
+    return tb_signature_code(*a) - tb_signature_code(*b);
+}
+
+static bool write_all(FILE* file, const void* data, size_t size, uint64_t* offset) {
+    *offset += size;
+    return fwrite(data, 1, size, file) == size;
+}
+
+static bool pad(FILE* file, uint64_t* offset) {
+    static const uint8_t zeros[sizeof(uint64_t)] = {0};
+    size_t size = (sizeof(uint64_t) - *offset % sizeof(uint64_t)) % sizeof(uint64_t);
+    return write_all(file, zeros, size, offset);
+}
+
+static bool write_tablebase(const char* path, int max_pieces, const TBSignature* signatures, int count) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+    TBFileHeader header = {{0}, TB_VERSION, (uint32_t) max_pieces, (uint32_t) count, 0};
+    memcpy(header.magic, TB_MAGIC, 4);
+    TBTableHeader* directory = calloc(count, sizeof(TBTableHeader));
+    uint8_t* block = malloc(2 * TB_BLOCK_SIZE);
+    uint64_t offset = 0;
+    bool ok = directory != NULL && block != NULL && write_all(file, &header, sizeof(header), &offset);
+
+    for (int i = 0; ok && i < count; i++) {
+        const Table* table = tables[tb_signature_code(signatures[i])];
+        uint32_t block_count = (uint32_t) ((table->size + TB_BLOCK_SIZE - 1) / TB_BLOCK_SIZE);
+        uint64_t* offsets = malloc((block_count + 1) * sizeof(uint64_t));
+        ok = offsets != NULL;
+        for (uint32_t b = 0; ok && b < block_count; b++) {
+            uint64_t begin = (uint64_t) b * TB_BLOCK_SIZE;
+            int values = (table->size - begin < TB_BLOCK_SIZE) ? (int) (table->size - begin) : TB_BLOCK_SIZE;
+            offsets[b] = offset;
+            ok = write_all(file, block, tb_encode_block(&table->values[begin], values, block), &offset);
+        }
+        if (ok) {
+            offsets[block_count] = offset;
+            ok = pad(file, &offset);
+            directory[i] = (TBTableHeader) {table->signature, block_count, table->size, offset};
+        }
+        ok = ok && write_all(file, offsets, (block_count + 1) * sizeof(uint64_t), &offset);
+        free(offsets);
+    }
+
+    header.directory_offset = offset;
+    ok = ok && write_all(file, directory, count * sizeof(TBTableHeader), &offset);
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    free(directory);
+    free(block);
+    if (ok) printf("%s: %d tables, %llu bytes\n", path, count, (unsigned long long) offset);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <max pieces> <output file> [threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int max_pieces = atoi(argv[1]);
+    int threads = (argc > 3) ? atoi(argv[3]) : 1;
+    if (max_pieces < 2 || max_pieces > TB_MAX_PIECES) {
+        fprintf(stderr, "max pieces must be between 2 and %d\n", TB_MAX_PIECES);
+        return EXIT_FAILURE;
+    }
+    ThreadPool* pool = threadpool_create(threads > 0 ? threads : 1);
+    if (pool == NULL) {
+        fprintf(stderr, "can't start threads\n");
+        return EXIT_FAILURE;
+    }
+
+    // every material with at least one piece on each side
+    TBSignature* signatures = malloc(TB_SIGNATURE_CODES * sizeof(TBSignature));
+    int count = 0;
+    for (int wm = 0; wm <= max_pieces; wm++)
+        for (int wk = 0; wm + wk <= max_pieces; wk++)
+            for (int bm = 0; wm + wk + bm <= max_pieces; bm++)
+                for (int bk = 0; wm + wk + bm + bk <= max_pieces; bk++) {
+                    if (wm + wk == 0 || bm + bk == 0) continue;
+                    signatures[count++] = (TBSignature) {(uint8_t) wm, (uint8_t) wk, (uint8_t) bm, (uint8_t) bk};
+                }
+    qsort(signatures, count, sizeof(TBSignature), compare_signatures);
+
+    for (int i = 0; i < count; i++) {
+        if (tables[tb_signature_code(signatures[i])] == NULL) solve_group(pool, signatures[i]);
+    }
+    threadpool_destroy(pool);
+
+    bool ok = write_tablebase(argv[2], max_pieces, signatures, count);
+    if (!ok) fprintf(stderr, "can't write %s\n", argv[2]);
+    for (int i = 0; i < count; i++) {
+        Table* table = tables[tb_signature_code(signatures[i])];
+        free(table->values);
+        free(table);
+    }
+    free(signatures);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,207 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#include <assert.h>
+
+#define INITIAL_DEQUE_CAPACITY 64
+
+// pool and worker index of calling thread (set only in worker threads)
+static __thread const ThreadPool* current_pool = NULL;
+static __thread int current_worker = -1;
+
+typedef struct WorkerStart {
+    ThreadPool* pool;
+    int index;
+} WorkerStart;
+
+/* deque helpers */
+
+static void deque_init(TaskDeque* deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->capacity = INITIAL_DEQUE_CAPACITY;
+    deque->tasks = malloc(deque->capacity * sizeof(Task));
+    assert(deque->tasks != NULL);
+    deque->head = 0;
+    deque->count = 0;
+}
+
+static void deque_dispose(TaskDeque* deque) {
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->tasks);
+}
+
+static void deque_push_back(TaskDeque* deque, const Task* task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        Task* tasks = malloc(2 * deque->capacity * sizeof(Task));
+        assert(tasks != NULL);
+        for (int i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = *task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static bool deque_pop_back(TaskDeque* deque, Task* task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        deque->count--;
+        *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool deque_pop_front(TaskDeque* deque, Task* task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/* scheduling */
+
+// takes task from own deque (newest first) or steals from others (oldest first), worker is -1 for outside threads
+static bool find_task(ThreadPool* pool, int worker, Task* task) {
+    if (atomic_load(&pool->queued) == 0) return false;
+    bool found = (worker >= 0) && deque_pop_back(&pool->deques[worker], task);
+    int start = (worker >= 0) ? worker + 1 : 0;
+    for (int i = 0; !found && i < pool->size; i++) {
+        found = deque_pop_front(&pool->deques[(start + i) % pool->size], task);
+    }
+    if (found) atomic_fetch_sub(&pool->queued, 1);
+    return found;
+}
+
+static void run_task(ThreadPool* pool, const Task* task) {
+    task->function(task->arg);
+    if (atomic_fetch_sub(&task->group->pending, 1) == 1) {
+        // group is done, wake up whoever waits for it
+        pthread_mutex_lock(&pool->sleep_lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
+
+static void* worker_main(void* arg) {
+    WorkerStart start = *(WorkerStart*) arg;
+    free(arg);
+    ThreadPool* pool = start.pool;
+    current_pool = pool;
+    current_worker = start.index;
+
+    Task task;
+    while (true) {
+        if (find_task(pool, start.index, &task)) {
+            run_task(pool, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->shutdown)) {
+            pthread_cond_wait(&pool->wake, &pool->sleep_lock);
+        }
+        bool done = atomic_load(&pool->shutdown) && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->sleep_lock);
+        if (done) break;
+    }
+    return NULL;
+}
+
+ThreadPool* threadpool_create(int threads) {
+    if (threads < 1) return NULL;
+    ThreadPool* pool = malloc(sizeof(ThreadPool));
+    if (pool == NULL) return NULL;
+    pool->size = threads;
+    pool->threads = malloc(threads * sizeof(pthread_t));
+    pool->deques = malloc(threads * sizeof(TaskDeque));
+    assert(pool->threads != NULL && pool->deques != NULL);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->next_deque, 0);
+    atomic_init(&pool->shutdown, false);
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for (int i = 0; i < threads; i++) deque_init(&pool->deques[i]);
+
+    for (int i = 0; i < threads; i++) {
+        WorkerStart* start = malloc(sizeof(WorkerStart));
+        assert(start != NULL);
+        start->pool = pool;
+        start->index = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, start) != 0) {
+            // run with the workers we've got
+            free(start);
+            pool->size = i;
+            break;
+        }
+    }
+    if (pool->size == 0) {
+        threadpool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void threadpool_destroy(ThreadPool* pool) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->sleep_lock);
+    atomic_store(&pool->shutdown, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep_lock);
+    for (int i = 0; i < pool->size; i++) pthread_join(pool->threads[i], NULL);
+
+    int deques = pool->size;
+    for (int i = 0; i < deques; i++) deque_dispose(&pool->deques[i]);
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+int threadpool_worker_index(const ThreadPool* pool) {
+    return (current_pool == pool) ? current_worker : -1;
+}
+
+void task_group_init(TaskGroup* group) {
+    atomic_init(&group->pending, 0);
+}
+
+void threadpool_submit(ThreadPool* pool, TaskGroup* group, TaskFunction function, void* arg) {
+    Task task = {function, arg, group};
+    atomic_fetch_add(&group->pending, 1);
+    int worker = threadpool_worker_index(pool);
+    if (worker < 0) worker = (int) (atomic_fetch_add(&pool->next_deque, 1) % (unsigned) pool->size);
+    deque_push_back(&pool->deques[worker], &task);
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+void threadpool_wait(ThreadPool* pool, TaskGroup* group) {
+    int worker = threadpool_worker_index(pool);
+    Task task;
+    while (atomic_load(&group->pending) > 0) {
+        if (find_task(pool, worker, &task)) {
+            run_task(pool, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(&group->pending) > 0 && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->wake, &pool->sleep_lock);
+        }
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef CHECKERS_V2_THREADPOOL_H
+#define CHECKERS_V2_THREADPOOL_H
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+ * Work-stealing thread pool
+ * -------------------------
+ * every worker has its own deque of tasks. worker takes tasks from the back of its own deque
+ * (most recently added first) and, when it runs dry, steals from the front of other workers' deques.
+ * tasks submitted by a worker go to its own deque, tasks submitted from outside are spread round-robin.
+ *
+ * tasks are grouped in TaskGroups, thread that waits for a group runs queued tasks meanwhile,
+ * so tasks can submit and wait for their own subtasks without deadlocking the pool.
+ */
+
+typedef void (*TaskFunction)(void* arg);
+
+typedef struct Task {
+    TaskFunction function;
+    void* arg;
+    struct TaskGroup* group;
+} Task;
+
+typedef struct TaskDeque {
+    pthread_mutex_t lock;
+    Task* tasks;   // ring buffer
+    int capacity;
+    int head;      // index of front task
+    int count;
+} TaskDeque;
+
+typedef struct TaskGroup {
+    atomic_int pending; // submitted tasks that haven't finished yet
+} TaskGroup;
+
+typedef struct ThreadPool {
+    int size;
+    pthread_t* threads;
+    TaskDeque* deques;       // one per worker
+    atomic_int queued;       // tasks sitting in deques
+    atomic_uint next_deque;  // round-robin position for tasks from outside
+    atomic_bool shutdown;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;     // signalled when tasks are queued or a group finishes
+} ThreadPool;
+
+/*
+ * Starts pool with given number of worker threads, NULL on failure
+ */
+ThreadPool* threadpool_create(int threads);
+
+/*
+ * Stops workers (queued tasks are run first) and frees pool
+ */
+void threadpool_destroy(ThreadPool* pool);
+
+/*
+ * Index of worker thread that calls this function (0 .. size-1), -1 if caller is not a worker of pool
+ */
+int threadpool_worker_index(const ThreadPool* pool);
+
+void task_group_init(TaskGroup* group);
+
+/*
+ * Queues task, function(arg) will be run by some worker (or by thread waiting for group)
+ */
+void threadpool_submit(ThreadPool* pool, TaskGroup* group, TaskFunction function, void* arg);
+
+/*
+ * Returns when every task of group has finished, runs queued tasks while waiting
+ */
+void threadpool_wait(ThreadPool* pool, TaskGroup* group);
+
+#endif //CHECKERS_V2_THREADPOOL_H
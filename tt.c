@@ -0,0 +1,112 @@
+#include "tt.h"
+#include <string.h>
+#include <sys/mman.h>
+
+static uint64_t pack(const TTData* data) {
+    return (uint64_t) (uint16_t) data->score
+           | (uint64_t) data->depth << 16
+           | (uint64_t) data->bound << 24
+           | (uint64_t) data->move_from << 32
+           | (uint64_t) data->move_dest << 40
+           | (uint64_t) data->generation << 48;
+}
+
+static void unpack(uint64_t packed, TTData* data) {
+    data->score = (int16_t) (packed & 0xFFFF);
+    data->depth = (uint8_t) (packed >> 16);
+    data->bound = (uint8_t) (packed >> 24);
+    data->move_from = (uint8_t) (packed >> 32);
+    data->move_dest = (uint8_t) (packed >> 40);
+    data->generation = (uint8_t) (packed >> 48);
+}
+
+// entries are read and written with relaxed atomics (plain moves), xor check catches torn entries
+static void load_entry(const TTEntry* entry, uint64_t* key, uint64_t* data) {
+    *data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    *key = atomic_load_explicit(&entry->check, memory_order_relaxed) ^ *data;
+}
+
+static void save_entry(TTEntry* entry, uint64_t key, uint64_t data) {
+    atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+bool tt_init(TranspositionTable* tt, size_t megabytes) {
+    uint64_t count = 1;
+    while (count * 2 * sizeof(TTBucket) <= (uint64_t) megabytes * 1024 * 1024) count *= 2;
+    // straight from the OS: pages are page aligned and zeroed, and go back when table is freed
+    // (malloc keeps big freed blocks, so every resize would add to memory use)
+    void* buckets = mmap(NULL, count * sizeof(TTBucket), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buckets == MAP_FAILED) return false;
+    tt->buckets = buckets;
+    tt->mask = count - 1;
+    tt->generation = 0;
+    return true;
+}
+
+void tt_free(TranspositionTable* tt) {
+    if (tt->buckets != NULL) munmap(tt->buckets, (tt->mask + 1) * sizeof(TTBucket));
+    tt->buckets = NULL;
+    tt->mask = 0;
+}
+
+void tt_clear(TranspositionTable* tt) {
+    memset(tt->buckets, 0, (tt->mask + 1) * sizeof(TTBucket));
+}
+
+void tt_new_search(TranspositionTable* tt) {
+    tt->generation++;
+}
+
+bool tt_probe(const TranspositionTable* tt, uint64_t key, TTData* data) {
+    const TTBucket* bucket = &tt->buckets[key & tt->mask];
+    for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+        uint64_t entry_key, entry_data;
+        load_entry(&bucket->entries[i], &entry_key, &entry_data);
+        if (entry_key == key && entry_data != 0) {
+            unpack(entry_data, data);
+            return true;
+        }
+    }
+    return false;
+}
+
+void tt_store(TranspositionTable* tt, uint64_t key, int score, int depth, Bound bound, const BoardMove* move) {
+    TTBucket* bucket = &tt->buckets[key & tt->mask];
+    // same position if it's there, otherwise the least valuable entry: shallow and from old searches
+    TTEntry* replace = &bucket->entries[0];
+    uint64_t replace_key = 0, replace_data = 0;
+    int replace_worth = 1 << 30;
+    for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+        TTEntry* entry = &bucket->entries[i];
+        uint64_t entry_key, entry_data;
+        load_entry(entry, &entry_key, &entry_data);
+        if (entry_data == 0 || entry_key == key) {
+            replace = entry;
+            replace_key = entry_key;
+            replace_data = entry_data;
+            break;
+        }
+        TTData old;
+        unpack(entry_data, &old);
+        int worth = old.depth - 8 * (uint8_t) (tt->generation - old.generation);
+        if (worth < replace_worth) {
+            replace_worth = worth;
+            replace = entry;
+            replace_key = entry_key;
+            replace_data = entry_data;
+        }
+    }
+
+    TTData data = {(int16_t) score, (uint8_t) depth, (uint8_t) bound, TT_NO_MOVE, TT_NO_MOVE, tt->generation};
+    if (move != NULL) {
+        data.move_from = move->from;
+        data.move_dest = move->dest;
+    } else if (replace_key == key && replace_data != 0) {
+        TTData old;
+        unpack(replace_data, &old);
+        data.move_from = old.move_from;
+        data.move_dest = old.move_dest;
+    }
+    save_entry(replace, key, pack(&data));
+}
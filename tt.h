@@ -0,0 +1,73 @@
+#ifndef CHECKERS_V2_TT_H
+#define CHECKERS_V2_TT_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "bitboard.h"
+
+/*
+ * Transposition table
+ * -------------------
+ * fixed-size hash table of search results keyed by zobrist key.
+ * entries are grouped in buckets of 4, one bucket is exactly one 64 byte cache line,
+ * so a probe touches a single line. key picks the bucket, the whole key is kept in the entry
+ * to tell positions that share a bucket apart.
+ *
+ * table is shared by search threads without any locking. entry keeps key xor data instead of the key,
+ * so an entry torn by two threads writing it at the same time doesn't verify on probe
+ * and is treated as a miss.
+ */
+
+#define TT_BUCKET_SIZE 4
+#define TT_NO_MOVE 0xFF
+
+typedef enum {BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT} Bound;
+
+typedef struct TTData {
+    int16_t score;
+    uint8_t depth;
+    uint8_t bound;      // Bound
+    uint8_t move_from;  // best move (from/dest squares), TT_NO_MOVE if not known
+    uint8_t move_dest;
+    uint8_t generation; // search that stored the entry
+} TTData;
+
+typedef struct TTEntry {
+    _Atomic uint64_t check; // key ^ data
+    _Atomic uint64_t data;  // packed TTData, 0 if entry is empty
+} TTEntry;
+
+typedef struct TTBucket {
+    _Alignas(64) TTEntry entries[TT_BUCKET_SIZE];
+} TTBucket;
+
+typedef struct TranspositionTable {
+    TTBucket* buckets;
+    uint64_t mask;      // bucket count - 1 (bucket count is a power of two)
+    uint8_t generation;
+} TranspositionTable;
+
+/*
+ * Allocates table of (at most) given size in megabytes, returns false if memory can't be allocated
+ */
+bool tt_init(TranspositionTable* tt, size_t megabytes);
+void tt_free(TranspositionTable* tt);
+void tt_clear(TranspositionTable* tt);
+
+/*
+ * Starts new search: entries of older searches become preferred for replacement
+ */
+void tt_new_search(TranspositionTable* tt);
+
+/*
+ * Returns true and fills data if position with given key is in the table
+ */
+bool tt_probe(const TranspositionTable* tt, uint64_t key, TTData* data);
+
+/*
+ * Stores search result of position, move can be NULL (move stored earlier for this position is kept)
+ */
+void tt_store(TranspositionTable* tt, uint64_t key, int score, int depth, Bound bound, const BoardMove* move);
+
+#endif //CHECKERS_V2_TT_H
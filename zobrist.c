@@ -0,0 +1,31 @@
+#include "zobrist.h"
+#include <pthread.h>
+
+#define ZOBRIST_SEED 0x9E3779B97F4A7C15ull
+
+uint64_t zobrist_pieces[4][32];
+uint64_t zobrist_side;
+
+static pthread_once_t zobrist_once = PTHREAD_ONCE_INIT;
+
+// splitmix64 generator
+static uint64_t next_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static void fill_tables(void) {
+    uint64_t state = ZOBRIST_SEED;
+    for (int piece = 0; piece < 4; piece++) {
+        for (int sq = 0; sq < 32; sq++) {
+            zobrist_pieces[piece][sq] = next_random(&state);
+        }
+    }
+    zobrist_side = next_random(&state);
+}
+
+void zobrist_init(void) {
+    pthread_once(&zobrist_once, fill_tables);
+}
@@ -0,0 +1,26 @@
+#ifndef CHECKERS_V2_ZOBRIST_H
+#define CHECKERS_V2_ZOBRIST_H
+#include <stdint.h>
+
+/*
+ * Zobrist hashing
+ * ---------------
+ * every (piece kind, square) pair gets a random 64-bit number, key of a position is xor
+ * of numbers of all pieces on the board, plus zobrist_side if computer (black) is to move.
+ * squares are the 32 dark cells numbered as in bitboard.h (row * 4 + col / 2),
+ * so Game and Board give the same key for the same position.
+ * numbers come from a fixed seed, keys are the same in every run (and in files that store them)
+ */
+
+// king of each color comes right after its man (man + 1 is the king)
+typedef enum {zobrist_white_man, zobrist_white_king, zobrist_black_man, zobrist_black_king} ZobristPiece;
+
+extern uint64_t zobrist_pieces[4][32];
+extern uint64_t zobrist_side;
+
+/*
+ * Fills tables, safe to call many times and from many threads
+ */
+void zobrist_init(void);
+
+#endif //CHECKERS_V2_ZOBRIST_H